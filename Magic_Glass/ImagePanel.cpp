@@ -4,9 +4,14 @@
 	The implementation of ImagePanel.h
 */
 #include <QtGui>
+#include <cmath>
 #include "ImagePanel.h"
 #include "label.h"
 #include "histo.h"
+#include "medianfilter.h"
+#include "hough.h"
+#include "memorybudget.h"
+#include "imageloader.h"
 
 //	Constructor: setting up the background for the panel and initializes variables.
 ImagePanel::ImagePanel (QWidget* parent, Qt::WFlags f)
@@ -14,62 +19,460 @@ ImagePanel::ImagePanel (QWidget* parent, Qt::WFlags f)
 {
 	rgb = new Label;
 	histo = new Histo;
+	memory = 0;
+	loader = new ImageLoader (this);
+	zoom = 1.0;
+	released = false;
+	values [0] = values [1] = values [2] = 0;
 	setCursor (Qt::CrossCursor);
 	QPalette pal;
 	pal.setColor(QPalette::Window, QColor(Qt::black));
 	pal.setColor(QPalette::WindowText, QColor(Qt::white));
 	setPalette(pal);
 	setBackgroundRole(QPalette::Window);
-	setAutoFillBackground(true);
+	setAutoFillBackground(false);
+	setAttribute(Qt::WA_OpaquePaintEvent);
 	resize(sizeHint());
 	reset();
 	setMouseTracking (true);
 	log = prewitt = sobel = thresAll = thresInd = magGla = aveGS = lumGS = red = green = blue = false;
+	colorSpace = false;
+	spaceChannel = Histo::Hue;
+	morphOp = Morphology::None;
+	morphElement = Morphology::Rectangle;
+	morphSize = 3;
 	thresValue = 0;
 	radius = 60;
+	magnification = 1;
+	median = 0;
+	inputPending = false;
+	coarseLens = false;
+
+	connect (this, SIGNAL (displayHisto (int, int, int)), histo, SLOT (showHisto (int, int, int)));
+	connect (histo, SIGNAL (statisticsReady()), this, SLOT (statisticsReady()));
+
+	connect (loader, SIGNAL (fullImageReady (const QImage &)), this, SLOT (fullImageReady (const QImage &)));
 }
 
 //	Destructor
 ImagePanel::~ImagePanel() {
-
+  if (memory)
+	memory -> forget (this);
+  unmapSource();
+  delete histo;
 }
 
 //	Reset some variables to original state.
 void ImagePanel::reset() {
   _px = 0; _py = 0;
+  loader -> cancel();
+  unmapSource();
+  histo -> histoCalc (QImage());
+  histo -> releasePlanes();
+  statsPending = false;
   image = QImage();
-  copyIm = QImage();
-  magicIm = QImage();
+  regions.clear();
+  lines.clear();
+  circles.clear();
+  fullSize = QSize();
+  frameSize = QSize();
+  level = 1;
+  refineTimer.stop();
+  pool.release();
+  copyIm = &pool.image (FramePool::Scaled);
+  magicIm = &pool.image (FramePool::Lens);
+  lensRect = QRect();
+  zoom = 1.0;
+  released = false;
+  reportMemory();
   repaint();
 }
 
 /*
 	This function get called from the open() of MainWindow
-	Convert the pixmap obatained from MainWindow to image, send it to Histo to calculate the histogram,
-		and make a deep copy of it for later use.
+	Decode a reduced-resolution version of the file that fits the view and show it right away,
+		zoomed out; the full-resolution decode continues in the background (fullImageReady).
+	A thumbnail of the file (from the folder browser, with the size of the image it was made
+		from) is shown enlarged to fit instead, which saves the reduced decode.
+	Returns false if the file cannot be read.
 */
-void ImagePanel::show(QPixmap p)
+bool ImagePanel::load (const QString &fileName, const QImage &thumbnail, const QSize &thumbnailSource)
 {
-  image = p.toImage();
-  copyIm = magicIm = image.copy(QRect());
-  repaint();
+  loader -> cancel();
+  histo -> cancelCalc();
+  unmapSource();
+  if (mapped.openNetpbm (fileName))
+  {
+	showMapped();
+	return true;
+  }
+
+  if (!thumbnail.isNull() && !thumbnailSource.isEmpty())
+  {
+	_px = 0; _py = 0;
+	fullSize = thumbnailSource;
+	if (thumbnail.size() == fullSize)
+	{
+	  setImage (thumbnail, 1.0);
+	  statsPending = true;
+	}
+	else
+	{
+	  setImage (thumbnail, fitZoom());
+	  loader -> start (fileName);
+	}
+	return true;
+  }
+
+  QWidget *view = parentWidget() ? parentWidget() : this;
+  QSize size;
+  QImage preview = ImageLoader::preview (fileName, view -> size(), &size);
+  if (preview.isNull())
+	return false;
+
+  _px = 0; _py = 0;
+  fullSize = size;
+  if (preview.size() == fullSize)
+  {
+	setImage (preview, 1.0);
+	statsPending = true;
+  }
+  else
+  {
+	setImage (preview, (double)preview.width() / fullSize.width());
+	loader -> start (fileName);
+  }
+  return true;
+}
+
+// Map a headerless raw file of size pixels in format and show it.  Returns false if the file is too small for that.
+bool ImagePanel::loadRaw (const QString &fileName, const QSize &size, MappedImage::Format format)
+{
+  loader -> cancel();
+  histo -> cancelCalc();
+  unmapSource();
+  if (!mapped.openRaw (fileName, size, format))
+	return false;
+  showMapped();
+  return true;
+}
+
+/*
+	Show the mapped image zoomed to fit the view.  There is no background decode: every pixel is already there.
+	16-bit samples are shown through a display window over the file's whole sample range.
+*/
+void ImagePanel::showMapped()
+{
+  _px = 0; _py = 0;
+  fullSize = mapped.view().size();
+  if (mapped.view().isDeep())
+  {
+	deep = mapped.view();
+	deep.setWindow (0, mapped.maxValue());
+  }
+  setImage (mapped.image(), fitZoom());
+  statsPending = true;
+}
+
+//	The zoom at which an image of fullSize fits the view; 1 if it fits already.
+double ImagePanel::fitZoom() const
+{
+  const QWidget *view = parentWidget() ? parentWidget() : this;
+  QSize fit = fullSize;
+  if (!view -> size().isEmpty() && (fit.width() > view -> width() || fit.height() > view -> height()))
+	fit.scale (view -> size(), Qt::KeepAspectRatio);
+  return (double)qMax (1, fit.width()) / fullSize.width();
+}
+
+/*
+	Let go of a memory-mapped source.  A statistics calculation may still be reading it on a
+		worker thread, so it is stopped and waited for first.
+*/
+void ImagePanel::unmapSource()
+{
+  if (mapped.view().isNull())
+	return;
+  histo -> cancelCalc();
+  histo -> waitForCalc();
+  image = QImage();
+  deep = ImageView();
+  mapped.close();
+}
+
+/*
+	Show an image that is already in memory at 1:1.  The histogram is calculated in the
+		background once the image has been painted.
+*/
+void ImagePanel::show(const QImage &im)
+{
+  _px = 0; _py = 0;
+  loader -> cancel();
+  fullSize = im.size();
+  histo -> cancelCalc();
+  unmapSource();
+  setImage (im, 1.0);
+  statsPending = true;
+}
+
+//	The background decode finished: swap the full-resolution image in, keeping the current zoom.
+void ImagePanel::fullImageReady (const QImage &im)
+{
+  if (im.isNull())
+	return;
+  fullSize = im.size();
+  setImage (im, zoom);
+  statsPending = true;
+}
+
+/*
+	Start the statistics stage once the full-resolution image is on screen.  Skipped when another
+		file started loading in the meantime; its own first paint will start it again.
+	The estimate startCalc() installs right away is shown like finished statistics.
+*/
+void ImagePanel::startStatistics()
+{
+  if (!hasImage() || loader -> isLoading())
+	return;
+  if (deep.isNull() && mapped.view().isNull())
+	histo -> startCalc (image);
+  else
+	histo -> startCalc (sourceView());
+  statisticsReady();
 }
 
+//	The statistics (or their estimate) are ready: refresh the label for the color under the cursor, and an equalized view built before them.
+void ImagePanel::statisticsReady()
+{
+  reportMemory();
+  if (colorSpace && spaceChannel == Histo::Equalize && !magGla)
+	colorSpaceView();
+  emit displayHisto (values [0], values [1], values [2]);
+}
 
-//	The image zooming implementation.
+/*
+	Keep the source in the format the loader produced when pixelaccess.h can read it (a 32-bit
+		copy otherwise) and rebuild the pooled 32-bit display buffer, which the lens and edge
+		kernels read from, at the given zoom.
+*/
+void ImagePanel::setImage (const QImage &im, double factor)
+{
+  image = ImageView::supports (im) ? im : im.convertToFormat (QImage::Format_RGB32);
+  regions.clear();
+  lines.clear();
+  circles.clear();
+  scaleImage (factor);
+}
+
+// The full-resolution source (the decoded image, the mapped file, or its 16-bit samples) for the kernels to read.
+ImageView ImagePanel::sourceView() const
+{
+  if (!deep.isNull())
+	return deep;
+  return mapped.view().isNull() ? ImageView (image) : mapped.view();
+}
+
+
+/*
+	The image zooming implementation.  The scaled frame is written into the pooled buffer.
+	factor is relative to the full-resolution size, even while only the preview has been decoded.
+*/
 void ImagePanel::scaleImage (double factor)
 {
-	scaleWidth = factor * (double)image.width();
-	scaleHeight = factor * (double)image.height();
-	magicIm = copyIm = image.scaled (scaleWidth, scaleHeight);
-	if (prewitt)
-		prewittM();
-	else if (sobel)
-		sobelM();
-	else if (log)
-		LoGM();
+	refineTimer.stop();
+	buildFrame (factor, 1);
+}
+
+/*
+	Zoom while the user is still zooming.  A frame of more than PreviewPixels is built at half,
+		quarter (or coarser) resolution and drawn enlarged, so each step costs the same at any image
+		size; refine() rebuilds it at full resolution once zooming has paused for RefineDelay ms.
+*/
+void ImagePanel::previewScale (double factor)
+{
+	double pixels = factor * fullSize.width() * factor * fullSize.height();
+	int frameLevel = 1;
+	while (pixels > (double)PreviewPixels * frameLevel * frameLevel)
+		frameLevel *= 2;
+
+	buildFrame (factor, frameLevel);
+	if (frameLevel > 1)
+		refineTimer.start (RefineDelay, this);
+	else
+		refineTimer.stop();
+}
+
+// Build the pooled frame for a zoom factor, frameLevel times smaller in each direction than it is shown, and the view derived from it.
+void ImagePanel::buildFrame (double factor, int frameLevel)
+{
+	zoom = factor;
+	level = frameLevel;
+	released = false;
+	scaleWidth = factor * (double)fullSize.width();
+	scaleHeight = factor * (double)fullSize.height();
+	frameSize = QSize (qMax (1, (int)scaleWidth), qMax (1, (int)scaleHeight));
+	QSize size ((frameSize.width() + level - 1) / level, (frameSize.height() + level - 1) / level);
+	QImage &scaled = pool.image (FramePool::Scaled, size);
+	histo -> scaleImage (sourceView(), scaled);
+	copyIm = &scaled;
+	resetLens();
+	if (prewitt || sobel || log)
+		edgeDetect();
+	else if (colorSpace && !magGla)
+		colorSpaceView();
 	else
 		repaint();
+	reportMemory();
+}
+
+// Current zoom factor of this document.
+double ImagePanel::scaleFactor() const
+{
+	return zoom;
+}
+
+// Whether an image has been loaded into this document.
+bool ImagePanel::hasImage() const
+{
+	return !image.isNull() || !mapped.view().isNull();
+}
+
+// Whether the image has 16 bits per sample and is shown through a display window.
+bool ImagePanel::isDeep() const
+{
+	return !deep.isNull();
+}
+
+// The sample shown as black.
+int ImagePanel::windowLow() const
+{
+	return deep.windowLow;
+}
+
+// The sample shown as white.
+int ImagePanel::windowHigh() const
+{
+	return deep.windowHigh;
+}
+
+/*
+	Show the 16-bit samples from low (black) to high (white).  The frame, the binned histograms
+		and the views built from them are redone; regions thresholded under the old window go.
+*/
+void ImagePanel::setWindow (int low, int high)
+{
+	if (deep.isNull())
+		return;
+	deep.setWindow (low, high);
+	histo -> setWindow (deep);
+	clearRegions();
+	scaleImage (zoom);
+}
+
+// Whether magic glass is enabled for this document.
+bool ImagePanel::isMagic() const
+{
+	return magGla;
+}
+
+// Whether the full-resolution image is still being decoded in the background.
+bool ImagePanel::isDecoding() const
+{
+	return loader -> isLoading();
+}
+
+// Whether a mouse position is still waiting for the next frame tick.
+bool ImagePanel::framePending() const
+{
+	return inputPending;
+}
+
+// The frame as it is on screen: the lens buffer while magic glass is on, else the scaled or edge frame.
+const QImage &ImagePanel::shownImage() const
+{
+	return magGla ? *magicIm : *copyIm;
+}
+
+// Draw the lens centered on an image position, as if the mouse were there.
+void ImagePanel::moveLens (const QPoint &pos)
+{
+	pending = pos + QPoint (_px, _py);
+	renderFrame();
+}
+
+// Input has been quiet for RefineDelay ms: redo a coarse frame and a coarse lens at full resolution.
+void ImagePanel::refine()
+{
+	refineTimer.stop();
+	bool lens = coarseLens;
+	if (level > 1)
+		buildFrame (zoom, 1);
+	if (magGla && lens)
+		renderFrame();
+}
+
+// A rectangle of the pooled frame in frame coordinates on screen.
+QRect ImagePanel::displayRect (const QRect &r) const
+{
+	return QRect (r.left() * level, r.top() * level, r.width() * level, r.height() * level);
+}
+
+// The histograms of this document's image.
+Histo *ImagePanel::histogram() const
+{
+	return histo;
+}
+
+// Attach the shared memory accountant.
+void ImagePanel::setMemoryBudget (MemoryBudget *budget)
+{
+	memory = budget;
+	reportMemory();
+}
+
+/*
+	Called by MemoryBudget when this document is inactive and memory is short.
+	Drops every pooled buffer; the source image and histograms stay.
+*/
+void ImagePanel::releaseDerived()
+{
+	refineTimer.stop();
+	pool.release();
+	histo -> releasePlanes();
+	copyIm = &pool.image (FramePool::Scaled);
+	magicIm = &pool.image (FramePool::Lens);
+	lensRect = QRect();
+	released = hasImage();
+	reportMemory();
+}
+
+// Rebuild the derived buffers (scaled frame, edge view) after they were released.
+void ImagePanel::restoreDerived()
+{
+	if (released)
+		scaleImage (zoom);
+}
+
+// Tell the memory accountant what this document currently holds.
+void ImagePanel::reportMemory()
+{
+	if (!memory)
+		return;
+	memory -> track (this, MemoryBudget::Source, mapped.view().isNull() ? image.byteCount() : mapped.heapBytes());
+	memory -> track (this, MemoryBudget::Statistics, histo -> statisticsBytes());
+	memory -> track (this, MemoryBudget::Derived, pool.bytes());
+	memory -> track (this, MemoryBudget::Cache, histo -> cacheBytes());
+}
+
+// Start the lens buffer over as a plain copy of the scaled frame.
+void ImagePanel::resetLens()
+{
+	const QImage &scaled = pool.image (FramePool::Scaled);
+	QImage &lens = pool.image (FramePool::Lens, scaled.size());
+	if (!scaled.isNull())
+		memcpy (lens.bits(), scaled.bits(), scaled.byteCount());
+	magicIm = &lens;
+	lensRect = QRect();
+	coarseLens = false;
 }
 
 // Setting red band to true and everything else to false
@@ -77,6 +480,7 @@ void ImagePanel::redBand()
 {
 	red = true;
 	log = prewitt = sobel = thresAll = thresInd = aveGS = lumGS = green = blue = false;
+	colorSpace = false;
 }
 
 // Setting green band to true and everything else to false
@@ -84,6 +488,7 @@ void ImagePanel::greenBand()
 {
 	green = true;
 	log = prewitt = sobel = thresAll = thresInd = aveGS = lumGS = red = blue = false;
+	colorSpace = false;
 }
 
 // Setting blue band to true and everything else to false
@@ -91,6 +496,7 @@ void ImagePanel::blueBand()
 {
 	blue = true;
 	log = prewitt = sobel = thresAll = thresInd = aveGS = lumGS = red = green = false;
+	colorSpace = false;
 }
 
 // Setting average grayscale to true and everything else to false
@@ -98,6 +504,7 @@ void ImagePanel::aveGrayScale()
 {
 	aveGS = true;
 	log = prewitt = sobel = thresAll = thresInd = lumGS = red = green = blue = false;
+	colorSpace = false;
 }
 
 // Setting luminance grayscale to true and everything else to false
@@ -105,6 +512,7 @@ void ImagePanel::lumGrayScale()
 {
 	lumGS = true;
 	log = prewitt = sobel = thresAll = thresInd = aveGS = red = green = blue = false;
+	colorSpace = false;
 }
 
 // Called from MainWindow.  MainWindow passes threshold value to here.
@@ -112,6 +520,87 @@ void ImagePanel::thresChanged (int value)
 {
 	thresValue = value;
 	histo -> lookUpTable (thresValue);
+	clearRegions();
+}
+
+/*
+	Threshold the whole source image with the current level (all bands or any single band) and
+		morphology, then find its connected bright regions.  They stay drawn on top of the image
+		until the level or the image changes.
+*/
+QVector<Component> ImagePanel::findRegions (bool eightConnected)
+{
+	regions.clear();
+	if (hasImage() && (thresAll || thresInd))
+	{
+		ImageView source = sourceView();
+		Plane mask = pool.plane (FramePool::Mask, source.size());
+		histo -> thresholdPlane (source, mask, thresInd);
+		regions = findComponents (mask, eightConnected);
+		reportMemory();
+	}
+	update();
+	return regions;
+}
+
+/*
+	Straight lines through the edges of the shown frame (see hough.h).  They stay drawn until the
+		image changes or clearShapes() is called; lines found at one zoom are kept at another.
+*/
+QVector<HoughLine> ImagePanel::findLines (const HoughSettings &settings)
+{
+	refine();
+	lines.clear();
+	const QImage &scaled = pool.image (FramePool::Scaled);
+	if (!scaled.isNull())
+	{
+		lines = houghLines (edgeSource(), settings);
+		double k = (double)sourceView().width / scaled.width();
+		for (int i = 0; i < lines.size(); i++)
+			lines [i].rho *= k;
+		reportMemory();
+	}
+	update();
+	return lines;
+}
+
+// Circles through the edges of the shown frame, kept like the lines.
+QVector<HoughCircle> ImagePanel::findCircles (const HoughSettings &settings)
+{
+	refine();
+	circles.clear();
+	const QImage &scaled = pool.image (FramePool::Scaled);
+	if (!scaled.isNull())
+	{
+		circles = houghCircles (edgeSource(), settings);
+		double k = (double)sourceView().width / scaled.width();
+		for (int i = 0; i < circles.size(); i++)
+		{
+			circles [i].x *= k;
+			circles [i].y *= k;
+			circles [i].radius *= k;
+		}
+		reportMemory();
+	}
+	update();
+	return circles;
+}
+
+void ImagePanel::clearShapes()
+{
+	if (lines.isEmpty() && circles.isEmpty())
+		return;
+	lines.clear();
+	circles.clear();
+	update();
+}
+
+void ImagePanel::clearRegions()
+{
+	if (regions.isEmpty())
+		return;
+	regions.clear();
+	update();
 }
 
 // Setting threshold all to true and everything else to false.
@@ -119,6 +608,68 @@ void ImagePanel::thresholdAll()
 {
 	thresAll = true;
 	log = prewitt = sobel = thresInd = aveGS = lumGS = red = green = blue = false;
+	colorSpace = false;
+}
+
+// Morphology applied to the threshold views inside the glass.
+void ImagePanel::setMorphology (Morphology::Operation op, Morphology::Element element, int size)
+{
+	morphOp = op;
+	morphElement = element;
+	morphSize = size;
+	histo -> setMorphology (op, element, size);
+}
+
+Morphology::Operation ImagePanel::morphologyOperation() const
+{
+	return morphOp;
+}
+
+Morphology::Element ImagePanel::morphologyElement() const
+{
+	return morphElement;
+}
+
+int ImagePanel::morphologySize() const
+{
+	return morphSize;
+}
+
+// The view this document shows; band, gray and threshold views only count while the glass is on.
+ImagePanel::View ImagePanel::view() const
+{
+	if (colorSpace)
+		return ChannelView;
+	if (magGla)
+	{
+		if (red)
+			return RedView;
+		if (green)
+			return GreenView;
+		if (blue)
+			return BlueView;
+		if (aveGS)
+			return AverageView;
+		if (lumGS)
+			return LuminanceView;
+		if (thresAll)
+			return ThresholdAllView;
+		if (thresInd)
+			return ThresholdBandsView;
+	}
+	else if (prewitt)
+		return PrewittView;
+	else if (sobel)
+		return SobelView;
+	else if (log)
+		return LoGView;
+	return Plain;
+}
+
+// The color-space or equalized channel of a ChannelView.
+Histo::Channel ImagePanel::channel() const
+{
+	return spaceChannel;
 }
 
 // Setting threshold individual to true and everything else to false.
@@ -126,7 +677,38 @@ void ImagePanel::thresholdSin()
 {
 	thresInd = true;
 	log = prewitt = sobel = thresAll = aveGS = lumGS = red = green = blue = false;
+	colorSpace = false;
+
+}
+
+/*
+	Show a color-space channel (hue, saturation, chroma, Cb, Cr, L*, a* or b*) as gray, or an
+		equalized view (global per band, or CLAHE of the luminance): inside the glass when magic
+		glass is on, else over the whole frame.
+*/
+void ImagePanel::colorSpaceChannel (Histo::Channel channel)
+{
+	colorSpace = true;
+	spaceChannel = channel;
+	log = prewitt = sobel = thresAll = thresInd = aveGS = lumGS = red = green = blue = false;
+	if (!magGla)
+		colorSpaceView();
+}
 
+// CLAHE tile grid and clip limit; an adaptive view on screen is redone.
+void ImagePanel::setClahe (int columns, int rows, double clip)
+{
+	histo -> setClahe (columns, rows, clip);
+	if (colorSpace && spaceChannel == Histo::Adaptive)
+	{
+		if (magGla)
+		{
+			resetLens();
+			renderFrame();
+		}
+		else
+			colorSpaceView();
+	}
 }
 
 // magGla correspond whether magic glass is enable or not.
@@ -135,44 +717,127 @@ void ImagePanel::thresholdSin()
 void ImagePanel::magic (bool ans)
 {
 	magGla = ans;
+	colorSpace = false;
+	copyIm = &pool.image (FramePool::Scaled);
+	resetLens();
 	if (magGla)
-	{
 		redBand();
-		update();
-	}
-	else
-	{
-		image = image.scaled (copyIm.width(), copyIm.height());
-		copyIm = image.copy(QRect());
-		update();
-	}
+	update();
 }
 
 // Edge detection.
 void ImagePanel::prewittM()
 {
 	prewitt = true;
-	log = sobel = false;
-	copyIm = histo -> prewittMask (image, copyIm);
-	update();
+	log = sobel = colorSpace = false;
+	edgeDetect();
 }
 
 // Edge detection
 void ImagePanel::sobelM()
 {
 	sobel = true;
-	log = prewitt = false;
-	copyIm = histo -> sobelMask (image, copyIm);
-	update();
+	log = prewitt = colorSpace = false;
+	edgeDetect();
 }
 
 // Edge detection
 void ImagePanel::LoGM()
 {
 	log = true;
-	prewitt = sobel = false;
-	copyIm = histo -> LoGMask (image, copyIm);
+	prewitt = sobel = colorSpace = false;
+	edgeDetect();
+}
+
+// Median prefilter radius for the edge operators (0 turns it off); re-runs the edge view if one is shown.
+void ImagePanel::setMedianRadius (int r)
+{
+	median = qBound (0, r, 15);
+	if (prewitt || sobel || log)
+		edgeDetect();
+}
+
+int ImagePanel::medianRadius() const
+{
+	return median;
+}
+
+// Gray plane of the scaled frame the edge operators and the Hough transforms work on, median filtered if asked for.
+Plane ImagePanel::edgeSource()
+{
+	const QImage &scaled = pool.image (FramePool::Scaled);
+	Plane gray = pool.plane (FramePool::Gray, scaled.size());
+	histo -> grayPlane (ImageView (scaled), gray);
+	if (median > 0)
+	{
+		Plane filtered = pool.plane (FramePool::Median, scaled.size());
+		medianFilter (gray, filtered, median);
+		gray = filtered;
+	}
+	return gray;
+}
+
+/*
+	Run the selected edge operator on the scaled frame, using pooled gray and output buffers.
+	A 16-bit source is resampled into a 16-bit gray plane instead, so the operators see its full
+		precision; the response is then shown in display-window levels.  With the median prefilter
+		on, the 8-bit frame is used.
+*/
+void ImagePanel::edgeDetect()
+{
+	const QImage &scaled = pool.image (FramePool::Scaled);
+	if (scaled.isNull())
+		return;
+
+	if (!deep.isNull() && median == 0)
+	{
+		Plane16 gray = pool.plane16 (FramePool::Gray, scaled.size());
+		histo -> deepGrayPlane (deep, gray);
+		QImage &edge = pool.image (FramePool::Edge, scaled.size());
+		float gain = 255.0f / (deep.windowHigh - deep.windowLow);
+		if (prewitt)
+			histo -> prewittMask (gray, edge, gain);
+		else if (sobel)
+			histo -> sobelMask (gray, edge, gain);
+		else
+			histo -> LoGMask (gray, edge, gain);
+		copyIm = &edge;
+		update();
+		reportMemory();
+		return;
+	}
+
+	Plane gray = edgeSource();
+	QImage &edge = pool.image (FramePool::Edge, scaled.size());
+	if (prewitt)
+		histo -> prewittMask (gray, edge);
+	else if (sobel)
+		histo -> sobelMask (gray, edge);
+	else
+		histo -> LoGMask (gray, edge);
+
+	copyIm = &edge;
+	update();
+	reportMemory();
+}
+
+// Whole-frame view of the chosen color-space or equalized channel, drawn from what Histo caches for the scaled frame.
+void ImagePanel::colorSpaceView()
+{
+	const QImage &scaled = pool.image (FramePool::Scaled);
+	if (scaled.isNull())
+		return;
+
+	QImage &view = pool.image (FramePool::Edge, scaled.size());
+	if (spaceChannel == Histo::Equalize)
+		histo -> equalizeImage (ImageView (scaled), view);
+	else if (spaceChannel == Histo::Adaptive)
+		histo -> grayToImage (histo -> clahePlane (ImageView (scaled)), view);
+	else
+		histo -> grayToImage (histo -> channelPlane (spaceChannel, ImageView (scaled)), view);
+	copyIm = &view;
 	update();
+	reportMemory();
 }
 
 // Obtain radius from Label
@@ -181,21 +846,125 @@ void ImagePanel::setRadius (int rad)
 	radius = rad;
 }
 
+// Obtain the lens magnification from Label (1 is off) and redraw the lens with it.
+void ImagePanel::setMagnification (int factor)
+{
+	magnification = qBound (1, factor, 16);
+	if (magGla && hasImage())
+		renderFrame();
+}
+
+// Bicubic instead of bilinear resampling for the magnified lens.
+void ImagePanel::setBicubic (bool on)
+{
+	histo -> setInterpolation (on ? Magnifier::Bicubic : Magnifier::Bilinear);
+	if (magGla && hasImage() && magnification > 1)
+		renderFrame();
+}
+
 //	Paint the "current" image, which is copyIm.  If magic glass is enabled, also paint the glass on top of copyIm.
+//	Only the exposed rectangles are drawn (see scroll() in renderFrame); the rest is filled with black.
+//	A coarse frame (level above 1, see previewScale) is enlarged to frameSize as it is drawn.
 void ImagePanel::paintEvent(QPaintEvent *e) {
   QPainter painter(this);
-  painter.setBackgroundMode(Qt::OpaqueMode);
-  painter.setBackground(QBrush(Qt::black));
-  if (magGla)
+  const QImage *shown = magGla ? magicIm : copyIm;
+  QRect imageRect = shown -> isNull() ? QRect() : QRect (QPoint (_px, _py), frameSize);
+  QVector<QRect> exposed = e -> region().rects();
+
+  for (int i = 0; i < exposed.size(); i++)
   {
-	 painter.drawImage(_px,_py,magicIm);
+	QRect inside = exposed [i] & imageRect;
+	if (!inside.isEmpty())
+	{
+		QRect source = inside.translated (-_px, -_py);
+		if (level == 1)
+			painter.drawImage (inside.topLeft(), *shown, source);
+		else
+			painter.drawImage (QRectF (inside), *shown, QRectF ((double)source.x() / level, (double)source.y() / level,
+							   (double)source.width() / level, (double)source.height() / level));
+	}
+
+	QVector<QRect> outside = (QRegion (exposed [i]) - QRegion (inside)).rects();
+	for (int j = 0; j < outside.size(); j++)
+		painter.fillRect (outside [j], Qt::black);
   }
-  else
+  paintRegions (painter, e -> rect());
+  paintShapes (painter);
+
+  if (statsPending)
   {
-     painter.drawImage(_px,_py,copyIm);
+	statsPending = false;
+	QTimer::singleShot (0, this, SLOT (startStatistics()));
   }
 }
 
+//	Outline every region that meets the view with its bounding box and mark its centroid.
+void ImagePanel::paintRegions (QPainter &painter, const QRect &view)
+{
+  if (regions.isEmpty() || !hasImage())
+	return;
+
+  double s = (double)frameSize.width() / sourceView().width;
+  painter.setPen (Qt::yellow);
+  for (int i = 0; i < regions.size(); i++)
+  {
+	const Component &c = regions [i];
+	QRect box (qRound (c.bounds.left() * s) + _px, qRound (c.bounds.top() * s) + _py,
+			   qMax (1, qRound (c.bounds.width() * s)), qMax (1, qRound (c.bounds.height() * s)));
+	if (!box.adjusted (-1, -1, 1, 1).intersects (view))
+		continue;
+
+	painter.drawRect (box);
+	QPoint centre (qRound (c.x * s) + _px, qRound (c.y * s) + _py);
+	painter.drawLine (centre - QPoint (2, 0), centre + QPoint (2, 0));
+	painter.drawLine (centre - QPoint (0, 2), centre + QPoint (0, 2));
+  }
+}
+
+//	Draw the Hough lines across the shown frame and the Hough circles.
+void ImagePanel::paintShapes (QPainter &painter)
+{
+  if ((lines.isEmpty() && circles.isEmpty()) || !hasImage())
+	return;
+
+  double s = (double)frameSize.width() / sourceView().width;
+  double w = frameSize.width();
+  double h = frameSize.height();
+  painter.setPen (Qt::green);
+  for (int i = 0; i < lines.size(); i++)
+  {
+	// Where x cos + y sin = rho meets the four borders; the two points inside make the segment.
+	double c = std::cos (lines [i].theta);
+	double n = std::sin (lines [i].theta);
+	double rho = lines [i].rho * s;
+	QVector<QPointF> ends;
+	if (std::fabs (n) > 1e-9)
+	{
+		double y0 = rho / n;
+		double y1 = (rho - w * c) / n;
+		if (y0 >= 0 && y0 <= h)
+		  ends << QPointF (0, y0);
+		if (y1 >= 0 && y1 <= h)
+		  ends << QPointF (w, y1);
+	}
+	if (std::fabs (c) > 1e-9)
+	{
+		double x0 = rho / c;
+		double x1 = (rho - h * n) / c;
+		if (x0 > 0 && x0 < w)
+		  ends << QPointF (x0, 0);
+		if (x1 > 0 && x1 < w)
+		  ends << QPointF (x1, h);
+	}
+	if (ends.size() >= 2)
+		painter.drawLine (QLineF (ends [0], ends [1]).translated (_px, _py));
+  }
+
+  painter.setPen (Qt::cyan);
+  for (int i = 0; i < circles.size(); i++)
+	painter.drawEllipse (QPointF (circles [i].x * s + _px, circles [i].y * s + _py), circles [i].radius * s, circles [i].radius * s);
+}
+
 //	Stores the current coordinates when mouse pressed.
 void ImagePanel::mousePressEvent(QMouseEvent* e) {
   _pressed = true;
@@ -208,9 +977,9 @@ void ImagePanel::mouseReleaseEvent(QMouseEvent*) {
 }
 
 /*
-	When mouse key pressed, move image 2-pixels at a time and then repaint it.
-	If key is not pressed, get the RGB values, xy coordinates at current points.
-	If magic glass is enabled, pass the current coordinate, radius, and images to histo to create magic glass.
+	When mouse key pressed, accumulate the drag offset (1-pixel granularity) for the next frame.
+	The position is then handed to the frame loop: the first move renders immediately, later moves
+		within the same frame only replace the pending position (see renderFrame).
 */
 void ImagePanel::mouseMoveEvent(QMouseEvent* e)
 {
@@ -222,43 +991,119 @@ void ImagePanel::mouseMoveEvent(QMouseEvent* e)
 	  if (x > this -> width() || x < 0 || y > this -> height() || y < 0)
 	  	return;
 
-	  int dx = x - _x;
-	  int dy = y - _y;
-
-	  if(dx < 0) {
-		dx += (x%2);
-		x += (x%2);
-	  } else {
-		dx -= (x%2);
-		x -= (x%2);
-	  }
-
-	  if(dy < 0) {
-		dy += (y%2);
-		y += (y%2);
-	  } else {
-		dy -= (y%2);
-		y -= (y%2);
-	  }
-
+	  pendingPan += QPoint (x - _x, y - _y);
 	  _x = x;
 	  _y = y;
-	  _px += dx;
-	  _py += dy;
-  	  update();
   }
 
-	QPixmap pic = QPixmap::grabWidget(this);
- 	QImage im = pic.toImage();
-  	color = im.pixel (x, y);
-	emit labelChanged (qRed(color), qGreen(color), qBlue(color), x, y);
-	emit displayHisto (qRed(color), qGreen(color), qBlue(color));
+	// Only the latest position is kept; the frame loop consumes it at most once per frame.
+	pending = QPoint (x, y);
+	inputPending = true;
+	if (!frameTimer.isActive())
+	{
+		renderFrame (true);
+		frameTimer.start (FrameInterval, this);
+	}
+}
+
+//	Frame tick: render the latest pending position, or stop ticking once input has gone quiet.
+//	The refine tick comes RefineDelay ms after the last coarse frame or lens.
+void ImagePanel::timerEvent(QTimerEvent* e)
+{
+	if (e -> timerId() == refineTimer.timerId())
+	{
+		refine();
+		return;
+	}
+	if (e -> timerId() != frameTimer.timerId())
+	{
+		QWidget::timerEvent (e);
+		return;
+	}
+
+	if (inputPending)
+		renderFrame (true);
+	else
+		frameTimer.stop();
+}
+
+/*
+	One frame of interaction: apply the accumulated pan, redraw the glass at the latest cursor position and schedule a repaint of
+		only the old and new glass areas, then send a single label/histogram update.
+	A preview frame (mouse input) samples a lens of more than LensPixels every 2nd or 4th pixel; the full lens follows at rest.
+*/
+void ImagePanel::renderFrame (bool preview)
+{
+	inputPending = false;
+	int x = pending.x();
+	int y = pending.y();
+
+	// Panning scrolls the existing backing store; only the newly exposed strips get repainted.
+	if (!pendingPan.isNull())
+	{
+		_px += pendingPan.x();
+		_py += pendingPan.y();
+		scroll (pendingPan.x(), pendingPan.y());
+		pendingPan = QPoint();
+	}
 
 	if (magGla)
 	{
+		QRect previous = lensRect;
 		histo -> setState (red, green, blue, aveGS, lumGS, thresAll, thresInd, thresValue);
-		magicIm = histo -> magicGlass (image, copyIm, radius, (x - _px), (y - _py));
-		repaint();
+		if (colorSpace)
+			histo -> setChannel (spaceChannel);
+
+		int rad = radius / level;
+		int step = 1;
+		if (preview && magnification == 1)
+			while ((2 * rad + 1) * (2 * rad + 1) > LensPixels * step * step && step < 4)
+				step *= 2;
+
+		// A magnified lens resamples the source for just its own pixels, so it needs no coarse preview.
+		ImageView frame (pool.image (FramePool::Scaled));
+		if (magnification > 1)
+			lensRect = histo -> magnifiedGlass (sourceView(), frame, *magicIm, lensRect, rad, (x - _px) / level, (y - _py) / level, magnification);
+		else
+			lensRect = histo -> magicGlass (frame, *magicIm, lensRect, rad, (x - _px) / level, (y - _py) / level, step);
+		update (displayRect (previous | lensRect).translated (_px, _py));
+		coarseLens = step > 1 || level > 1;
+		if (coarseLens)
+			refineTimer.start (RefineDelay, this);
+	}
+
+	sampleAt (x, y);
+	emit labelChanged (values [0], values [1], values [2], x, y);
+	emit displayHisto (values [0], values [1], values [2]);
+}
+
+//	The values the label shows for widget position x, y: the color as shown, or for a 16-bit source the samples there (0 outside the image).
+void ImagePanel::sampleAt (int x, int y)
+{
+	values [0] = values [1] = values [2] = 0;
+	if (!QRect (QPoint (_px, _py), frameSize).contains (x, y))
+		return;
+
+	if (!deep.isNull())
+	{
+		int sx = qMin (deep.width - 1, (int)((qint64)(x - _px) * deep.width / frameSize.width()));
+		int sy = qMin (deep.height - 1, (int)((qint64)(y - _py) * deep.height / frameSize.height()));
+		const quint16 *p = (const quint16 *)deep.scanLine (sy);
+		if (deep.layout == ImageView::Gray16)
+			values [0] = values [1] = values [2] = p [sx];
+		else
+			for (int i = 0; i < 3; i++)
+				values [i] = p [3 * sx + i];
+		return;
+	}
+
+	const QImage *shown = magGla ? magicIm : copyIm;
+	if (shown -> valid ((x - _px) / level, (y - _py) / level))
+	{
+		QRgb color = shown -> pixel ((x - _px) / level, (y - _py) / level);
+		values [0] = qRed (color);
+		values [1] = qGreen (color);
+		values [2] = qBlue (color);
 	}
 }
 //Wai Khoo
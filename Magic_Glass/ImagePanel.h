@@ -13,17 +13,50 @@
 #include <QtGui>
 #include "label.h"
 #include "histo.h"
+#include "framepool.h"
+#include "components.h"
+#include "hough.h"
+#include "mappedimage.h"
+
+class MemoryBudget;
+class ImageLoader;
 
 class ImagePanel : public QWidget
 {
 	Q_OBJECT
  public:
+  // What the document shows: a band, gray or threshold view inside the glass, a channel view (inside the glass or over the frame) or an edge view.
+  enum View {Plain, RedView, GreenView, BlueView, AverageView, LuminanceView, ThresholdAllView, ThresholdBandsView, ChannelView, PrewittView, SobelView, LoGView};
+
   ImagePanel(QWidget* parent=0, Qt::WFlags f=0);
   ~ImagePanel();
 
   void reset();
-  void show(QPixmap);
+  bool load(const QString &fileName, const QImage &thumbnail = QImage(), const QSize &thumbnailSource = QSize());
+  bool loadRaw (const QString &fileName, const QSize &size, MappedImage::Format format);
+  void show(const QImage &im);
   void scaleImage (double factor);
+  void previewScale (double factor);
+  double scaleFactor() const;
+  bool hasImage() const;
+  bool isDeep() const;
+  int windowLow() const;
+  int windowHigh() const;
+  void setWindow (int low, int high);
+  bool isDecoding() const;
+  bool framePending() const;
+  const QImage &shownImage() const;
+  void moveLens (const QPoint &pos);
+  bool isMagic() const;
+  View view() const;
+  Histo::Channel channel() const;
+  Morphology::Operation morphologyOperation() const;
+  Morphology::Element morphologyElement() const;
+  int morphologySize() const;
+  Histo *histogram() const;
+  void setMemoryBudget (MemoryBudget *budget);
+  void releaseDerived();
+  void restoreDerived();
   void redBand();
   void greenBand();
   void blueBand();
@@ -32,13 +65,30 @@ class ImagePanel : public QWidget
   void thresChanged (int value);
   void thresholdAll();
   void thresholdSin();
+  void colorSpaceChannel (Histo::Channel channel);
+  void setClahe (int columns, int rows, double clip);
+  void setMorphology (Morphology::Operation op, Morphology::Element element, int size);
   void magic (bool ans);
   void prewittM();
   void sobelM();
   void LoGM();
+  void setMedianRadius (int r);
+  QVector<Component> findRegions (bool eightConnected);
+  void clearRegions();
+  QVector<HoughLine> findLines (const HoughSettings &settings);
+  QVector<HoughCircle> findCircles (const HoughSettings &settings);
+  void clearShapes();
+  int medianRadius() const;
 
 public slots:
   void setRadius (int rad);
+  void setMagnification (int factor);
+  void setBicubic (bool on);
+
+private slots:
+  void fullImageReady (const QImage &im);
+  void startStatistics();
+  void statisticsReady();
 
 signals:
 	void labelChanged (int r, int g, int b, int x, int y);
@@ -49,27 +99,79 @@ protected:
   void mousePressEvent(QMouseEvent* e);
   void mouseReleaseEvent(QMouseEvent* e);
   void mouseMoveEvent(QMouseEvent* e);
+  void timerEvent(QTimerEvent* e);
 
  private:
+  // Frame pacing for mouse driven updates (~60 Hz display refresh).
+  enum {FrameInterval = 16};
+  // Progressive refinement: while input is active the zoomed frame and the lens are computed from at most
+  // PreviewPixels and LensPixels samples; RefineDelay ms after the last input they are redone at full resolution.
+  enum {RefineDelay = 150, PreviewPixels = 1 << 20, LensPixels = 128 * 128};
+
+  void buildFrame (double factor, int frameLevel);
+  void refine();
+  QRect displayRect (const QRect &r) const;
+  void edgeDetect();
+  Plane edgeSource();
+  void colorSpaceView();
+  void resetLens();
+  void renderFrame (bool preview = false);
+  void paintRegions (QPainter &painter, const QRect &view);
+  void paintShapes (QPainter &painter);
+  void reportMemory();
+  void setImage (const QImage &im, double factor);
+  ImageView sourceView() const;
+  void sampleAt (int x, int y);
+  void showMapped();
+  double fitZoom() const;
+  void unmapSource();
+
   Label *rgb;
   Histo *histo;
+  FramePool pool;
+  MemoryBudget *memory;
+  ImageLoader *loader;
 
   QImage image;
-  QImage copyIm;
-  QImage magicIm;
+  MappedImage mapped;		// the file PGM/PPM and raw sources are read from in place
+  ImageView deep;		// 16-bit samples in mapped, with their display window; null for 8-bit sources
+  QSize fullSize;
+  QSize frameSize;		// size of the zoomed frame on screen; the pooled buffers are level times smaller
+  QImage *copyIm;
+  QImage *magicIm;
+  QRect lensRect;
+  QVector<Component> regions;		// bright regions of the threshold mask, in source image coordinates
+  QVector<HoughLine> lines;		// Hough lines and circles of the edge source, in source image coordinates
+  QVector<HoughCircle> circles;
+  QBasicTimer frameTimer;
+  QBasicTimer refineTimer;
+  QPoint pending;
+  QPoint pendingPan;
 
-  QRgb color;
+  int values [3];		// red, green and blue under the cursor as shown, or the samples of a 16-bit source
   int _px;
   int _py;
   int _x;
   int _y;
   int radius;
+  int magnification;		// of the lens over the frame around it; 1 draws the frame's own pixels
+  int median;
   int thresValue;
+  int level;
+  Histo::Channel spaceChannel;
+  Morphology::Operation morphOp;		// last passed to histo, for the menus of the active document
+  Morphology::Element morphElement;
+  int morphSize;
 
   double scaleWidth;
   double scaleHeight;
+  double zoom;
 
   bool _pressed;
+  bool inputPending;
+  bool coarseLens;
+  bool statsPending;
+  bool released;
   bool red;
   bool green;
   bool blue;
@@ -81,6 +183,7 @@ protected:
   bool prewitt;
   bool sobel;
   bool log;
+  bool colorSpace;
 };
 
 #endif
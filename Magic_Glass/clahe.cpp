@@ -0,0 +1,249 @@
+/*
+	The implementation of clahe.h.
+*/
+#include <QtGui>
+#include "clahe.h"
+#include "rowkernels.h"
+
+namespace
+{
+	// Tile grid over a plane: tile i spans [edge (i), edge (i + 1)).
+	struct Grid
+	{
+		Grid (int w, int h, int c, int r) : width (w), height (h), columns (c), rows (r) {}
+
+		int left (int i) const { return width * i / columns; }
+		int top (int j) const { return height * j / rows; }
+
+		int width;
+		int height;
+		int columns;
+		int rows;
+	};
+
+	// Builds the clipped, equalizing table of one tile into luts [tile * 256].
+	struct TileLut
+	{
+		TileLut (const Plane &s, const Grid &g, double c, uchar *l) : src (s), grid (g), clip (c), luts (l) {}
+
+		void operator() (const int &tile) const
+		{
+			int tx = tile % grid.columns;
+			int ty = tile / grid.columns;
+			int x0 = grid.left (tx), x1 = grid.left (tx + 1);
+			int y0 = grid.top (ty), y1 = grid.top (ty + 1);
+			int area = (x1 - x0) * (y1 - y0);
+			uchar *lut = luts + tile * 256;
+
+			if (area <= 0)
+			{
+				for (int v = 0; v < 256; v++)
+					lut [v] = v;
+				return;
+			}
+
+			int histo [256];
+			memset (histo, 0, sizeof (histo));
+			for (int y = y0; y < y1; y++)
+			{
+				const uchar *in = src.scanLine (y);
+				for (int x = x0; x < x1; x++)
+					histo [in [x]]++;
+			}
+
+			// Clip, then hand the excess out evenly; what does not divide goes to every step-th bin.
+			int limit = qMax (1, (int)(clip * area / 256));
+			int excess = 0;
+			for (int v = 0; v < 256; v++)
+				if (histo [v] > limit)
+				{
+					excess += histo [v] - limit;
+					histo [v] = limit;
+				}
+			int each = excess / 256;
+			int rest = excess % 256;
+			for (int v = 0; v < 256; v++)
+				histo [v] += each;
+			if (rest)
+				for (int v = 0, step = qMax (1, 256 / rest); v < 256 && rest; v += step, rest--)
+					histo [v]++;
+
+			int sum = 0;
+			for (int v = 0; v < 256; v++)
+			{
+				sum += histo [v];
+				lut [v] = (uchar)qMin (255, (int)(((qint64)sum * 255 + area / 2) / area));
+			}
+		}
+
+		Plane src;
+		Grid grid;
+		double clip;
+		uchar *luts;
+	};
+
+	// Position of a pixel between two tile centers: the lower tile and the weight (0..256) of the upper one.
+	inline void between (int pos, int count, int length, int &first, int &weight)
+	{
+		// Center of tile i is at (2 i + 1) length / (2 count); work in units of 1 / (2 count).
+		int p = 2 * count * pos + count;		// 2 count (pos + 0.5)
+		int i = (p - length) / (2 * length);	// tile whose center is at or below pos
+		if (p < length)
+		{
+			first = 0;
+			weight = 0;
+			return;
+		}
+		if (i >= count - 1)
+		{
+			first = count - 1;
+			weight = 0;
+			return;
+		}
+		int c0 = (2 * i + 1) * length;			// center of tile i, same units
+		first = i;
+		weight = (int)(((qint64)(p - c0) * 256) / (2 * length));
+	}
+
+	/*
+		Blends row band b of bands of dst from the tile tables.  Each band works in its own part of
+			scratch: a row of blended tables (grid.columns x 256) and the two gathered rows.
+	*/
+	struct BlendRows
+	{
+		BlendRows (const Plane &s, const Plane &d, const Grid &g, const uchar *l,
+				   const QVector<int> &t, const QVector<ushort> &w, int n, ushort *sc)
+			: src (s), dst (d), grid (g), luts (l), tiles (t), weights (w), bands (n), scratch (sc) {}
+
+		static int scratchSize (const Grid &grid) { return grid.columns * 256 + 2 * grid.width; }
+
+		void operator() (const int &band) const
+		{
+			int w = src.width;
+			ushort *row = scratch + band * scratchSize (grid);
+			ushort *pa = row + grid.columns * 256;
+			ushort *pb = pa + w;
+			const RowKernels &kernels = rowKernels();
+
+			for (int y = src.height * band / bands; y < src.height * (band + 1) / bands; y++)
+			{
+				int ty, wy;
+				between (y, grid.rows, grid.height, ty, wy);
+				const uchar *upper = luts + ty * grid.columns * 256;
+				const uchar *lower = luts + qMin (ty + 1, grid.rows - 1) * grid.columns * 256;
+				for (int i = 0; i < grid.columns * 256; i++)
+					row [i] = upper [i] * (256 - wy) + lower [i] * wy;
+
+				const uchar *in = src.scanLine (y);
+				for (int x = 0; x < w; x++)
+				{
+					int t = tiles [x] * 256 + in [x];
+					pa [x] = row [t];
+					pb [x] = row [t + (tiles [x] < grid.columns - 1 ? 256 : 0)];
+				}
+				kernels.blend (pa, pb, weights.constData(), dst.scanLine (y), w);
+			}
+		}
+
+		Plane src;
+		Plane dst;
+		Grid grid;
+		const uchar *luts;
+		const QVector<int> &tiles;
+		const QVector<ushort> &weights;
+		int bands;
+		ushort *scratch;
+	};
+
+	// The list 0 .. count - 1 of work items, kept when it already has that many.
+	void numbers (QList<int> &list, int count)
+	{
+		if (list.size() == count)
+			return;
+		list.clear();
+		for (int i = 0; i < count; i++)
+			list << i;
+	}
+}
+
+Clahe::Clahe()
+	: columns (8), rows (8), clip (2.0)
+{
+}
+
+// Size of the tile grid; at least 1 x 1.
+void Clahe::setTiles (int c, int r)
+{
+	columns = qMax (1, c);
+	rows = qMax (1, r);
+}
+
+// Clip limit as a multiple of the mean bin count; 1 gives an almost unchanged image, large values plain AHE.
+void Clahe::setClipLimit (double limit)
+{
+	clip = qMax (1.0, limit);
+}
+
+int Clahe::tileColumns() const
+{
+	return columns;
+}
+
+int Clahe::tileRows() const
+{
+	return rows;
+}
+
+double Clahe::clipLimit() const
+{
+	return clip;
+}
+
+/*
+	Equalize src into dst (same size, different buffer).
+	The tables and the work lists are kept for the next call, so equalizing a plane of the same
+		size again (the lens, every frame) allocates nothing.
+*/
+void Clahe::apply (const Plane &src, const Plane &dst)
+{
+	if (src.isNull())
+		return;
+
+	Grid grid (src.width, src.height, qMin (columns, src.width), qMin (rows, src.height));
+	luts.resize (grid.columns * grid.rows * 256);
+	numbers (tiles, grid.columns * grid.rows);
+	QtConcurrent::blockingMap (tiles, TileLut (src, grid, clip, luts.data()));
+
+	// Horizontal position of every column, shared by all rows.
+	left.resize (src.width);
+	weights.resize (src.width);
+	for (int x = 0; x < src.width; x++)
+	{
+		int weight;
+		between (x, grid.columns, grid.width, left [x], weight);
+		weights [x] = weight;
+	}
+
+	int bands = qMin (QThread::idealThreadCount() * 2, src.height);
+	numbers (work, bands);
+	scratch.resize (bands * BlendRows::scratchSize (grid));
+	QtConcurrent::blockingMap (work, BlendRows (src, dst, grid, luts.constData(), left, weights, bands, scratch.data()));
+}
+
+// Memory held by the tables and scratch rows kept between calls.
+qint64 Clahe::bytes() const
+{
+	return luts.capacity() + (qint64)left.capacity() * sizeof (int)
+		 + ((qint64)weights.capacity() + scratch.capacity()) * sizeof (ushort);
+}
+
+// Free the tables; they are allocated again by the next apply().
+void Clahe::release()
+{
+	luts = QVector<uchar>();
+	tiles.clear();
+	left = QVector<int>();
+	weights = QVector<ushort>();
+	work.clear();
+	scratch = QVector<ushort>();
+}
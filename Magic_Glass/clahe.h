@@ -0,0 +1,41 @@
+/*
+	Contrast-limited adaptive histogram equalization (CLAHE) of 8-bit planes.
+	The plane is cut into a grid of tiles.  Each tile's histogram is clipped at the clip limit
+		(a multiple of the mean bin count; the clipped counts are spread over all bins) and turned
+		into an equalizing lookup table.  Every pixel then blends the tables of the four tiles
+		whose centers surround it, bilinearly.
+	Tile tables are built in parallel.  The blend runs in parallel row bands: per row the two
+		tile rows are blended into one table per tile column, then the row is gathered from those
+		and blended horizontally by a vectorized row kernel (see rowkernels.h).
+*/
+#ifndef CLAHE_H
+#define CLAHE_H
+
+#include <QtGui>
+#include "imageview.h"
+
+class Clahe
+{
+public:
+	Clahe();
+	void setTiles (int columns, int rows);
+	void setClipLimit (double limit);
+	int tileColumns() const;
+	int tileRows() const;
+	double clipLimit() const;
+	void apply (const Plane &src, const Plane &dst);
+	qint64 bytes() const;
+	void release();
+
+private:
+	int columns;
+	int rows;
+	double clip;
+	QVector<uchar> luts;		// equalizing table of every tile, 256 entries each
+	QList<int> tiles;			// tile numbers, the work items of the tables
+	QVector<int> left;			// tile column left of every pixel column
+	QVector<ushort> weights;	// weight of the tile column right of it, out of 256
+	QList<int> work;			// row band numbers, the work items of the blend
+	QVector<ushort> scratch;	// rows each band blends in
+};
+#endif
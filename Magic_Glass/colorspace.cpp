@@ -0,0 +1,210 @@
+/*
+	The implementation of colorspace.h.
+*/
+#include <QtGui>
+#include <cmath>
+#include "colorspace.h"
+
+namespace
+{
+	enum {CubeSize = 4096};
+
+	// Lookup tables shared by every conversion, filled once.
+	struct Tables
+	{
+		Tables()
+		{
+			reciprocal [0] = 0;
+			for (int v = 1; v < 256; v++)
+				reciprocal [v] = (65536 + v / 2) / v;
+
+			for (int v = 0; v < 256; v++)
+			{
+				double c = v / 255.0;
+				linear [v] = (float)(c <= 0.04045 ? c / 12.92 : std::pow ((c + 0.055) / 1.055, 2.4));
+			}
+
+			for (int i = 0; i < CubeSize; i++)
+			{
+				double t = (double)i / (CubeSize - 1);
+				cube [i] = (float)(t > 0.008856 ? std::pow (t, 1.0 / 3.0) : 7.787 * t + 16.0 / 116.0);
+			}
+		}
+
+		int reciprocal [256];		// 65536 / v
+		float linear [256];			// sRGB to linear light
+		float cube [CubeSize];		// the L*a*b* f(t) over 0 <= t <= 1
+	};
+
+	const Tables &tables()
+	{
+		static const Tables t;
+		return t;
+	}
+
+	inline float cubeRoot (const Tables &t, float v)
+	{
+		int i = (int)(v * (CubeSize - 1) + 0.5f);
+		return t.cube [i < 0 ? 0 : (i >= CubeSize ? CubeSize - 1 : i)];
+	}
+
+	inline uchar clampByte (int v)
+	{
+		return v < 0 ? 0 : (v > 255 ? 255 : v);
+	}
+
+	// Converts rows [first, last) of one color space into its three (or two) planes.
+	struct ConvertRows
+	{
+		ConvertRows (int s, const ImageView &v, uchar *p0, uchar *p1, uchar *p2)
+			: space (s), src (v)
+		{
+			planes [0] = p0;
+			planes [1] = p1;
+			planes [2] = p2;
+		}
+
+		void operator() (const QPair<int, int> &rows) const
+		{
+			const Tables &t = tables();
+			int w = src.width;
+
+			for (int y = rows.first; y < rows.second; y++)
+			{
+				const QRgb *in = (const QRgb *)src.scanLine (y);
+				uchar *a = planes [0] + y * w;
+				uchar *b = planes [1] + y * w;
+				uchar *c = planes [2] ? planes [2] + y * w : 0;
+
+				for (int x = 0; x < w; x++)
+				{
+					int r = qRed (in [x]);
+					int g = qGreen (in [x]);
+					int bl = qBlue (in [x]);
+
+					if (space == 0)
+					{
+						int max = qMax (r, qMax (g, bl));
+						int chroma = max - qMin (r, qMin (g, bl));
+						int hue = 0;
+						if (chroma)
+						{
+							if (max == r)
+								hue = ((g - bl) * 60 * t.reciprocal [chroma]) >> 16;
+							else if (max == g)
+								hue = (((bl - r) * 60 * t.reciprocal [chroma]) >> 16) + 120;
+							else
+								hue = (((r - g) * 60 * t.reciprocal [chroma]) >> 16) + 240;
+							if (hue < 0)
+								hue += 360;
+						}
+						a [x] = hue * 255 / 360;
+						b [x] = (chroma * 255 * t.reciprocal [max]) >> 16;
+						c [x] = chroma;
+					}
+					else if (space == 1)
+					{
+						a [x] = clampByte (128 + ((-43 * r - 85 * g + 128 * bl) >> 8));
+						b [x] = clampByte (128 + ((128 * r - 107 * g - 21 * bl) >> 8));
+					}
+					else
+					{
+						float lr = t.linear [r];
+						float lg = t.linear [g];
+						float lb = t.linear [bl];
+						float fx = cubeRoot (t, (0.4124f * lr + 0.3576f * lg + 0.1805f * lb) / 0.95047f);
+						float fy = cubeRoot (t, 0.2126f * lr + 0.7152f * lg + 0.0722f * lb);
+						float fz = cubeRoot (t, (0.0193f * lr + 0.1192f * lg + 0.9505f * lb) / 1.08883f);
+						a [x] = clampByte ((int)((116.0f * fy - 16.0f) * 2.55f + 0.5f));
+						b [x] = clampByte ((int)(500.0f * (fx - fy) + 128.5f));
+						c [x] = clampByte ((int)(200.0f * (fy - fz) + 128.5f));
+					}
+				}
+			}
+		}
+
+		int space;
+		ImageView src;
+		uchar *planes [3];
+	};
+}
+
+ColorPlanes::ColorPlanes()
+{
+	invalidate();
+}
+
+ColorPlanes::Space ColorPlanes::spaceOf (Channel channel)
+{
+	if (channel <= Chroma)
+		return HSV;
+	if (channel <= Cr)
+		return YCbCr;
+	return Lab;
+}
+
+/*
+	The plane of one channel for the 32-bit frame src, converting its color space first if the
+		cache does not hold it.  The plane stays valid until invalidate() or release().
+*/
+Plane ColorPlanes::plane (Channel channel, const ImageView &src)
+{
+	if (src.size() != size)
+	{
+		invalidate();
+		size = src.size();
+	}
+
+	Space space = spaceOf (channel);
+	if (!valid [space])
+	{
+		convert (space, src);
+		valid [space] = true;
+	}
+	return Plane (buffers [channel].data(), size.width(), size.width(), size.height());
+}
+
+// The frame changed: planes are converted again on the next request (buffers are kept).
+void ColorPlanes::invalidate()
+{
+	for (int s = 0; s < SpaceCount; s++)
+		valid [s] = false;
+}
+
+// Drop the buffers as well.
+void ColorPlanes::release()
+{
+	invalidate();
+	for (int c = 0; c < ChannelCount; c++)
+		buffers [c] = QVector<uchar>();
+	rows.clear();
+}
+
+qint64 ColorPlanes::bytes() const
+{
+	qint64 total = 0;
+	for (int c = 0; c < ChannelCount; c++)
+		total += buffers [c].size();
+	return total;
+}
+
+// Convert all channels of one color space, in parallel row bands.
+void ColorPlanes::convert (Space space, const ImageView &src)
+{
+	Channel first = space == HSV ? Hue : (space == YCbCr ? Cb : LStar);
+	int count = space == YCbCr ? 2 : 3;
+	for (int c = first; c < first + count; c++)
+		buffers [c].resize (src.width * src.height);
+
+	// The bands are kept for the next frame of the same height, so converting the lens every frame does not allocate them.
+	if (rows.isEmpty() || rows.last().second != src.height)
+	{
+		int bands = qMin (QThread::idealThreadCount() * 2, src.height);
+		rows.clear();
+		for (int b = 0; b < bands; b++)
+			rows << qMakePair (src.height * b / bands, src.height * (b + 1) / bands);
+	}
+
+	QtConcurrent::blockingMap (rows, ConvertRows (space, src, buffers [first].data(), buffers [first + 1].data(),
+												 count == 3 ? buffers [first + 2].data() : 0));
+}
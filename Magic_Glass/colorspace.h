@@ -0,0 +1,37 @@
+/*
+	Hue/saturation/chroma (HSV), Cb/Cr (YCbCr) and L*a*b* channels of a 32-bit frame as 8-bit
+		planes.  The planes of a color space are converted together the first time one of them is
+		asked for and cached until the frame changes, so the lens only copies spans out of them.
+	Conversions use integers and lookup tables: a reciprocal table for HSV, fixed-point BT.601
+		weights for YCbCr, and sRGB linearization plus cube-root tables for L*a*b* (D65 white).
+	Planes are scaled to 0..255: hue 0..360 degrees, L* 0..100, a* and b* offset by 128.
+*/
+#ifndef COLORSPACE_H
+#define COLORSPACE_H
+
+#include <QtGui>
+#include "imageview.h"
+
+class ColorPlanes
+{
+public:
+	enum Channel {Hue, Saturation, Chroma, Cb, Cr, LStar, AStar, BStar, ChannelCount};
+
+	ColorPlanes();
+	Plane plane (Channel channel, const ImageView &src);
+	void invalidate();
+	void release();
+	qint64 bytes() const;
+
+private:
+	enum Space {HSV, YCbCr, Lab, SpaceCount};
+
+	static Space spaceOf (Channel channel);
+	void convert (Space space, const ImageView &src);
+
+	QVector<uchar> buffers [ChannelCount];
+	QList<QPair<int, int> > rows;		// row bands convert() splits the frame into
+	bool valid [SpaceCount];
+	QSize size;
+};
+#endif
@@ -0,0 +1,99 @@
+/*
+	The implementation of colortable.h.
+*/
+#include <QtGui>
+#include "colortable.h"
+
+ColorTable::ColorTable()
+{
+	clear();
+}
+
+// Empty the table, keeping a small initial capacity.
+void ColorTable::clear()
+{
+	keys.fill (Empty, 1024);
+	counts.fill (0, 1024);
+	used = 0;
+	mask = 1023;
+	shift = 32 - 10;
+}
+
+// Count a run of 32-bit pixels into the table; alpha is ignored.
+void ColorTable::addLine (const QRgb *line, int count)
+{
+	for (int x = 0; x < count; x++)
+		add (line [x] & 0xffffff, 1);
+}
+
+// Add the counts of another table (e.g. one counted over a different row band).
+void ColorTable::merge (const ColorTable &other)
+{
+	for (int i = 0; i < other.keys.size(); i++)
+		if (other.keys [i] != Empty)
+			add (other.keys [i], other.counts [i]);
+}
+
+// Number of pixels of exactly this color (alpha is ignored).
+quint32 ColorTable::count (QRgb color) const
+{
+	int i = slot (color & 0xffffff);
+	return keys [i] == Empty ? 0 : counts [i];
+}
+
+// Number of different colors in the image.
+int ColorTable::distinct() const
+{
+	return used;
+}
+
+qint64 ColorTable::bytes() const
+{
+	return (qint64)(keys.size() + counts.size()) * sizeof (quint32);
+}
+
+void ColorTable::add (quint32 key, quint32 n)
+{
+	int i = slot (key);
+	if (keys [i] == Empty)
+	{
+		if (2 * (used + 1) > keys.size())
+		{
+			grow();
+			i = slot (key);
+		}
+		keys [i] = key;
+		used++;
+	}
+	counts [i] += n;
+}
+
+// Double the capacity and re-insert every color.
+void ColorTable::grow()
+{
+	QVector<quint32> oldKeys = keys;
+	QVector<quint32> oldCounts = counts;
+
+	keys.fill (Empty, oldKeys.size() * 2);
+	counts.fill (0, oldKeys.size() * 2);
+	mask = keys.size() - 1;
+	shift--;
+
+	for (int i = 0; i < oldKeys.size(); i++)
+	{
+		if (oldKeys [i] == Empty)
+			continue;
+		int j = slot (oldKeys [i]);
+		keys [j] = oldKeys [i];
+		counts [j] = oldCounts [i];
+	}
+}
+
+// Linear probing from a multiplicative hash; returns the slot holding key or the empty slot where it goes.
+int ColorTable::slot (quint32 key) const
+{
+	int i = (int)((key * 2654435761u) >> shift);
+	while (keys [i] != Empty && keys [i] != key)
+		i = (i + 1) & mask;
+	return i;
+}
@@ -0,0 +1,37 @@
+/*
+	Joint RGB histogram stored as a compact open-addressing hash table.
+	Tables for separate row bands can be counted in parallel and merged afterwards.
+	Only colors that actually occur take space (two 32-bit words per slot, load factor at most 1/2),
+		instead of a dense table of 16M bins.  count() answers "how many pixels have exactly this
+		color" in O(1).
+*/
+#ifndef COLORTABLE_H
+#define COLORTABLE_H
+
+#include <QtGui>
+
+class ColorTable
+{
+public:
+	ColorTable();
+	void addLine (const QRgb *line, int count);
+	void merge (const ColorTable &other);
+	void clear();
+	quint32 count (QRgb color) const;
+	int distinct() const;
+	qint64 bytes() const;
+
+private:
+	enum {Empty = 0xffffffff};
+
+	void add (quint32 key, quint32 n);
+	void grow();
+	int slot (quint32 key) const;
+
+	QVector<quint32> keys;
+	QVector<quint32> counts;
+	int used;
+	int mask;
+	int shift;
+};
+#endif
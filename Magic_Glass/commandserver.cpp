@@ -0,0 +1,200 @@
+/*
+	The implementation of commandserver.h.
+*/
+#include <QtGui>
+#include <QtNetwork>
+#include "commandserver.h"
+#include "mainwindow.h"
+
+namespace
+{
+	// Commands without arguments and the MainWindow slot each one calls.
+	struct SlotCommand
+	{
+		const char *command;
+		const char *slot;
+	};
+
+	const SlotCommand slotCommands [] =
+	{
+		{"red", "red"},
+		{"green", "green"},
+		{"blue", "blue"},
+		{"average", "averageGrayScale"},
+		{"luminance", "luminanceGrayScale"},
+		{"threshold-all", "thresAll"},
+		{"threshold-individual", "thresInd"},
+		{"prewitt", "prewitt"},
+		{"sobel", "sobel"},
+		{"log", "LoG"},
+		{"restore", "restore"},
+		{"magic-on", "enMagicGlass"},
+		{"magic-off", "disMagicGlass"},
+		{"zoom-in", "zoomIn"},
+		{"zoom-out", "zoomOut"},
+		{"close", "closeDocument"}
+	};
+}
+
+CommandServer::CommandServer(MainWindow *w)
+	: QObject (w), window (w)
+{
+	server = new QLocalServer (this);
+	pixels = new QSharedMemory (this);
+	connect (server, SIGNAL (newConnection()), this, SLOT (newConnection()));
+}
+
+/*
+	Start accepting clients under the given name.  If the name is taken and nothing answers on it,
+		the socket file was left behind by an instance that crashed: it is removed and listening
+		is tried once more.  A running instance keeps the name, and false is returned.
+*/
+bool CommandServer::listen (const QString &name)
+{
+	if (server -> listen (name))
+		return true;
+
+	QLocalSocket probe;
+	probe.connectToServer (name);
+	if (probe.waitForConnected (1000))
+	{
+		probe.disconnectFromServer();
+		return false;
+	}
+	QLocalServer::removeServer (name);
+	return server -> listen (name);
+}
+
+void CommandServer::newConnection()
+{
+	while (server -> hasPendingConnections())
+	{
+		QLocalSocket *socket = server -> nextPendingConnection();
+		connect (socket, SIGNAL (readyRead()), this, SLOT (readCommands()));
+		connect (socket, SIGNAL (disconnected()), socket, SLOT (deleteLater()));
+	}
+}
+
+// Answer every complete line the client has sent so far.
+void CommandServer::readCommands()
+{
+	QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+	if (!socket)
+		return;
+
+	while (socket -> canReadLine())
+	{
+		QString line = QString::fromUtf8 (socket -> readLine()).trimmed();
+		if (!line.isEmpty())
+			socket -> write ((execute (line) + "\n").toUtf8());
+	}
+}
+
+QString CommandServer::execute (const QString &line)
+{
+	QStringList args = line.split (' ', QString::SkipEmptyParts);
+	QString command = args.takeFirst().toLower();
+	ImagePanel *panel = window -> activeDocument();
+
+	if (command == "open")
+	{
+		bool ok = false;
+		QString fileName = line.section (' ', 1).trimmed();
+		QMetaObject::invokeMethod (window, "openFile", Q_RETURN_ARG (bool, ok), Q_ARG (QString, fileName));
+		return ok ? "OK" : "ERROR cannot open " + fileName;
+	}
+
+	if (command == "status")
+		return QString ("OK %1 %2 %3").arg (panel -> hasImage()).arg (panel -> isDecoding()).arg (panel -> histogram() -> isReady());
+
+	if (!panel -> hasImage())
+		return "ERROR no image";
+
+	for (unsigned i = 0; i < sizeof (slotCommands) / sizeof (slotCommands [0]); i++)
+		if (command == slotCommands [i].command)
+		{
+			QMetaObject::invokeMethod (window, slotCommands [i].slot);
+			return "OK";
+		}
+
+	if (command == "threshold" && args.size() == 1)
+	{
+		int level = args [0].toInt();
+		QMetaObject::invokeMethod (window, "threshold", Q_ARG (int, level));
+		return "OK";
+	}
+
+	if (command == "radius" && args.size() == 1)
+	{
+		window -> label() -> setRadius (args [0].toInt());
+		return "OK";
+	}
+
+	if (command == "magnification" && args.size() == 1)
+	{
+		window -> label() -> setMagnification (args [0].toInt());
+		return "OK";
+	}
+
+	if (command == "lens" && args.size() == 2)
+	{
+		panel -> moveLens (QPoint (args [0].toInt(), args [1].toInt()));
+		return "OK";
+	}
+
+	if (command == "histogram")
+		return histogram();
+
+	if (command == "result")
+		return result();
+
+	return "ERROR unknown command " + command;
+}
+
+// The 256 red, then green, then blue counts of the active image, on one line.
+QString CommandServer::histogram()
+{
+	Histo *histo = window -> activeDocument() -> histogram();
+	if (!histo -> isReady())
+		return "ERROR pending";
+
+	QString reply = "OK";
+	Histo::Channel channels [3] = {Histo::Red, Histo::Green, Histo::Blue};
+	for (int c = 0; c < 3; c++)
+	{
+		QVector<int> counts = histo -> counts (channels [c]);
+		for (int i = 0; i < counts.size(); i++)
+			reply += " " + QString::number (counts [i]);
+	}
+	return reply;
+}
+
+/*
+	Copy the image on screen into the shared segment and reply with its key, width, height and
+		bytes per line.  Pixels are 32-bit 0xffRRGGBB.  The segment is reused while it is big
+		enough and stays valid until the next result command.
+	The frame is copied rather than drawn in the segment: the panel keeps drawing into its pooled
+		buffers on every mouse move, and the copy, one memcpy per command, is a snapshot the
+		client can read at its own pace.  It is written under the segment's lock; clients lock
+		it too while they read, so they never see half a frame.
+*/
+QString CommandServer::result()
+{
+	const QImage &shown = window -> activeDocument() -> shownImage();
+	if (shown.isNull())
+		return "ERROR no image";
+
+	if (pixels -> size() < shown.byteCount())
+	{
+		pixels -> detach();
+		pixels -> setKey (QString ("MagicGlass-%1-%2").arg (QApplication::applicationPid()).arg (shown.byteCount()));
+		if (!pixels -> create (shown.byteCount()))
+			return "ERROR " + pixels -> errorString();
+	}
+
+	pixels -> lock();
+	memcpy (pixels -> data(), shown.bits(), shown.byteCount());
+	pixels -> unlock();
+
+	return QString ("OK %1 %2 %3 %4").arg (pixels -> key()).arg (shown.width()).arg (shown.height()).arg (shown.bytesPerLine());
+}
@@ -0,0 +1,37 @@
+/*
+	Remote control of a running Magic Glass through a local socket (QLocalServer).
+	Clients send one command per line and get one reply line back, starting with OK or ERROR.
+	Commands are mapped onto the existing MainWindow slots; the shown image is handed over in
+		a shared memory segment whose key comes back in the reply, so pixels never go through
+		the socket or a file.  See README.md for the command list.
+*/
+#ifndef COMMANDSERVER_H
+#define COMMANDSERVER_H
+
+#include <QtGui>
+#include <QtNetwork>
+
+class MainWindow;
+
+class CommandServer : public QObject
+{
+	Q_OBJECT
+
+public:
+	CommandServer(MainWindow *window);
+	bool listen (const QString &name);
+
+private slots:
+	void newConnection();
+	void readCommands();
+
+private:
+	QString execute (const QString &line);
+	QString histogram();
+	QString result();
+
+	MainWindow *window;
+	QLocalServer *server;
+	QSharedMemory *pixels;
+};
+#endif
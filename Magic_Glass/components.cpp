@@ -0,0 +1,217 @@
+/*
+	The implementation of components.h.
+*/
+#include <QtGui>
+#include "components.h"
+
+namespace
+{
+	// Bright pixels x0 .. x1 (inclusive) of row y.
+	struct Run
+	{
+		int y;
+		int x0;
+		int x1;
+	};
+
+	// Runs of one row band; rows [first, last), runs of row first + i start at rowStart [i].
+	struct Band
+	{
+		int first;
+		int last;
+		QVector<Run> runs;
+		QVector<int> parent;
+		QVector<int> rowStart;
+	};
+
+	int findRoot (int *parent, int i)
+	{
+		while (parent [i] != i)
+		{
+			parent [i] = parent [parent [i]];
+			i = parent [i];
+		}
+		return i;
+	}
+
+	// Join two sets; the smaller index becomes the root so roots stay stable in run order.
+	void unite (int *parent, int a, int b)
+	{
+		a = findRoot (parent, a);
+		b = findRoot (parent, b);
+		if (a < b)
+			parent [b] = a;
+		else if (b < a)
+			parent [a] = b;
+	}
+
+	/*
+		Join every run in [a, aEnd) with the overlapping runs in [b, bEnd) of the next row.
+		With 8-connectivity runs that only touch diagonally overlap too (reach 1).
+	*/
+	void joinRows (const Run *runs, int *parent, int a, int aEnd, int b, int bEnd, int reach)
+	{
+		while (a < aEnd && b < bEnd)
+		{
+			if (runs [a].x1 + reach < runs [b].x0)
+				a++;
+			else if (runs [b].x1 + reach < runs [a].x0)
+				b++;
+			else
+			{
+				unite (parent, a, b);
+				if (runs [a].x1 < runs [b].x1)
+					a++;
+				else
+					b++;
+			}
+		}
+	}
+
+	struct LabelBand
+	{
+		typedef Band result_type;
+
+		LabelBand (const Plane &m, int r) : mask (m), reach (r) {}
+
+		Band operator() (const QPair<int, int> &rows) const
+		{
+			Band band;
+			band.first = rows.first;
+			band.last = rows.second;
+
+			for (int y = band.first; y < band.last; y++)
+			{
+				band.rowStart << band.runs.size();
+				const uchar *line = mask.scanLine (y);
+				int x = 0;
+				while (x < mask.width)
+				{
+					while (x < mask.width && !line [x])
+						x++;
+					if (x == mask.width)
+						break;
+					Run run = {y, x, x};
+					while (x < mask.width && line [x])
+						x++;
+					run.x1 = x - 1;
+					band.runs << run;
+				}
+			}
+			band.rowStart << band.runs.size();
+
+			band.parent.resize (band.runs.size());
+			int *parent = band.parent.data();
+			for (int i = 0; i < band.parent.size(); i++)
+				parent [i] = i;
+
+			for (int i = 0; i + 1 < band.last - band.first; i++)
+				joinRows (band.runs.constData(), parent, band.rowStart [i], band.rowStart [i + 1],
+						  band.rowStart [i + 1], band.rowStart [i + 2], reach);
+			return band;
+		}
+
+		Plane mask;
+		int reach;
+	};
+
+	bool largerComponent (const Component &a, const Component &b)
+	{
+		return a.area > b.area;
+	}
+
+	struct Totals
+	{
+		qint64 area;
+		qint64 sumX;
+		qint64 sumY;
+		int left;
+		int top;
+		int right;
+		int bottom;
+	};
+}
+
+// Components of mask, largest area first.
+QVector<Component> findComponents (const Plane &mask, bool eightConnected)
+{
+	QVector<Component> components;
+	if (mask.isNull())
+		return components;
+
+	int reach = eightConnected ? 1 : 0;
+	int bands = qMin (QThread::idealThreadCount() * 2, mask.height);
+	QList<QPair<int, int> > rows;
+	for (int b = 0; b < bands; b++)
+		rows << qMakePair (mask.height * b / bands, mask.height * (b + 1) / bands);
+
+	QList<Band> parts = QtConcurrent::blockingMapped<QList<Band> > (rows, LabelBand (mask, reach));
+
+	// Concatenate the bands, offsetting run indices, and join across band boundaries.
+	QVector<int> offset (parts.size() + 1, 0);
+	for (int b = 0; b < parts.size(); b++)
+		offset [b + 1] = offset [b] + parts [b].runs.size();
+
+	QVector<Run> runs (offset.last());
+	QVector<int> parent (offset.last());
+	for (int b = 0; b < parts.size(); b++)
+	{
+		const Band &band = parts [b];
+		for (int i = 0; i < band.runs.size(); i++)
+		{
+			runs [offset [b] + i] = band.runs [i];
+			parent [offset [b] + i] = band.parent [i] + offset [b];
+		}
+	}
+
+	for (int b = 0; b + 1 < parts.size(); b++)
+	{
+		const Band &upper = parts [b];
+		const Band &lower = parts [b + 1];
+		if (upper.runs.isEmpty() || lower.runs.isEmpty())
+			continue;
+		int rowsUp = upper.last - upper.first;
+		joinRows (runs.constData(), parent.data(),
+				  offset [b] + upper.rowStart [rowsUp - 1], offset [b] + upper.rowStart [rowsUp],
+				  offset [b + 1] + lower.rowStart [0], offset [b + 1] + lower.rowStart [1], reach);
+	}
+
+	// Add every run to the totals of its root.
+	QVector<int> index (runs.size(), -1);
+	QVector<Totals> totals;
+	int *p = parent.data();
+	for (int i = 0; i < runs.size(); i++)
+	{
+		int root = findRoot (p, i);
+		if (index [root] < 0)
+		{
+			index [root] = totals.size();
+			Totals t = {0, 0, 0, runs [i].x0, runs [i].y, runs [i].x1, runs [i].y};
+			totals << t;
+		}
+
+		const Run &run = runs [i];
+		Totals &t = totals [index [root]];
+		qint64 length = run.x1 - run.x0 + 1;
+		t.area += length;
+		t.sumX += (qint64)(run.x0 + run.x1) * length / 2;
+		t.sumY += (qint64)run.y * length;
+		t.left = qMin (t.left, run.x0);
+		t.right = qMax (t.right, run.x1);
+		t.top = qMin (t.top, run.y);
+		t.bottom = qMax (t.bottom, run.y);
+	}
+
+	components.resize (totals.size());
+	for (int i = 0; i < totals.size(); i++)
+	{
+		const Totals &t = totals [i];
+		components [i].area = t.area;
+		components [i].x = (double)t.sumX / t.area;
+		components [i].y = (double)t.sumY / t.area;
+		components [i].bounds = QRect (QPoint (t.left, t.top), QPoint (t.right, t.bottom));
+	}
+
+	qSort (components.begin(), components.end(), largerComponent);
+	return components;
+}
@@ -0,0 +1,23 @@
+/*
+	Connected components of the bright (non-zero) pixels of an 8-bit mask, with 4- or
+		8-connectivity.  Row bands are labeled in parallel: each band turns its rows into runs of
+		bright pixels and joins overlapping runs of neighbouring rows with union-find.  A merge
+		step then joins the runs that touch across band boundaries, and every run adds its
+		pixels to the statistics of its root.  Only runs are stored, never a label per pixel.
+*/
+#ifndef COMPONENTS_H
+#define COMPONENTS_H
+
+#include <QtGui>
+#include "imageview.h"
+
+struct Component
+{
+	qint64 area;
+	double x;		// centroid
+	double y;
+	QRect bounds;
+};
+
+QVector<Component> findComponents (const Plane &mask, bool eightConnected);
+#endif
@@ -0,0 +1,65 @@
+/*
+	The implementation of cpufeatures.h.
+*/
+#include <QtGui>
+#include <cstdlib>
+#include "cpufeatures.h"
+
+namespace
+{
+	CpuFeatures::Level probe()
+	{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports ("avx512f") && __builtin_cpu_supports ("avx512bw"))
+			return CpuFeatures::Avx512;
+		if (__builtin_cpu_supports ("avx2"))
+			return CpuFeatures::Avx2;
+#endif
+		return CpuFeatures::Generic;
+	}
+
+	// The level asked for in MAGIC_GLASS_ISA, capped at what the processor has.
+	CpuFeatures::Level choose()
+	{
+		CpuFeatures::Level best = CpuFeatures::detected();
+		QByteArray forced = QByteArray (getenv ("MAGIC_GLASS_ISA")).toLower();
+
+		CpuFeatures::Level wanted = best;
+		if (forced == "generic")
+			wanted = CpuFeatures::Generic;
+		else if (forced == "avx2")
+			wanted = CpuFeatures::Avx2;
+		else if (forced == "avx512")
+			wanted = CpuFeatures::Avx512;
+
+		return wanted <= best ? wanted : best;
+	}
+}
+
+// The instruction set level the processor supports.
+CpuFeatures::Level CpuFeatures::detected()
+{
+	static const Level cpu = probe();
+	return cpu;
+}
+
+// The instruction set level in use, after the environment override.
+CpuFeatures::Level CpuFeatures::level()
+{
+	static const Level chosen = choose();
+	return chosen;
+}
+
+QString CpuFeatures::name (Level level)
+{
+	switch (level)
+	{
+		case Avx2:
+			return "AVX2";
+		case Avx512:
+			return "AVX-512";
+		default:
+			return "generic";
+	}
+}
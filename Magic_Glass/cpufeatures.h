@@ -0,0 +1,20 @@
+/*
+	Which vector instruction set the kernels in rowkernels.cpp may use on this machine.
+	The level is read from CPUID once, at the first call.  The MAGIC_GLASS_ISA environment
+		variable (generic, avx2 or avx512) forces a lower level for testing; a level the
+		processor does not support is ignored.
+*/
+#ifndef CPUFEATURES_H
+#define CPUFEATURES_H
+
+#include <QtGui>
+
+namespace CpuFeatures
+{
+	enum Level {Generic, Avx2, Avx512};
+
+	Level level();
+	Level detected();
+	QString name (Level level);
+}
+#endif
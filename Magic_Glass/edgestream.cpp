@@ -0,0 +1,187 @@
+/*
+	The implementation of edgestream.h.
+*/
+#include <QtGui>
+#include "edgestream.h"
+#include "histo.h"
+#include "rowkernels.h"
+
+EdgeStream::EdgeStream()
+	: op (Sobel), width (0), height (0), channels (0), reach (1), rowsRead (0), rowsWritten (0)
+{
+}
+
+/*
+	Open the source and write the header of the output.  Returns false, with errorString() set,
+		if the source cannot be streamed or the output cannot be created.
+*/
+bool EdgeStream::open (const QString &input, const QString &output, Operator o)
+{
+	close();
+	sourceName = input;
+	op = o;
+	reach = op == LoG ? 2 : 1;
+
+	source.setFileName (input);
+	if (!source.open (QIODevice::ReadOnly))
+		return fail (tr("Cannot read %1.").arg (input));
+
+	if (!readHeader())
+		return fail (tr("%1 is not an 8-bit binary PGM or PPM file; convert it to one to stream it.").arg (input));
+
+	if (width < 1 || height < 1)
+		return fail (tr("%1 has no pixels.").arg (input));
+
+	target.setFileName (output);
+	if (!target.open (QIODevice::WriteOnly | QIODevice::Truncate))
+		return fail (tr("Cannot write %1.").arg (output));
+	target.write (QString ("P5\n%1 %2\n255\n").arg (width).arg (height).toAscii());
+
+	ring.resize ((2 * reach + 1) * width);
+	raw.resize (channels * width);
+	edges.resize (width);
+	line.resize (width);
+	error.clear();
+	return true;
+}
+
+// Stop and release everything; the output written so far stays on disk.
+void EdgeStream::close()
+{
+	source.close();
+	target.close();
+	ring = QVector<uchar>();
+	raw = QVector<uchar>();
+	edges = QVector<QRgb>();
+	line = QVector<uchar>();
+	width = height = channels = rowsRead = rowsWritten = 0;
+}
+
+/*
+	Compute and write up to rows more output rows.  Returns the number of rows written so far
+		(height() when done), or -1 on a read or write error.
+*/
+int EdgeStream::process (int rows)
+{
+	const RowKernels &kernels = rowKernels();
+	int window = 2 * reach + 1;
+
+	for (int end = qMin (height, rowsWritten + rows); rowsWritten < end; rowsWritten++)
+	{
+		int y = rowsWritten;
+		while (rowsRead <= qMin (height - 1, y + reach))
+		{
+			if (!readRow (ring.data() + (rowsRead % window) * width))
+				return -1;
+			rowsRead++;
+		}
+
+		QRgb *out = edges.data();
+		if (y < reach || y > height - 1 - reach)
+			edges.fill (qRgb (0, 0, 0));
+		else
+		{
+			const uchar *rowAt [5];
+			for (int d = -reach; d <= reach; d++)
+				rowAt [d + reach] = ring.constData() + ((y + d) % window) * width;
+
+			for (int x = 0; x < qMin (reach, width); x++)
+				out [x] = out [width - 1 - x] = qRgb (0, 0, 0);
+			if (op == Prewitt)
+				kernels.prewitt (rowAt [0], rowAt [1], rowAt [2], out, width);
+			else if (op == Sobel)
+				kernels.sobel (rowAt [0], rowAt [1], rowAt [2], out, width);
+			else
+				kernels.LoG (rowAt [0], rowAt [1], rowAt [2], rowAt [3], rowAt [4], out, width);
+		}
+
+		uchar *gray = line.data();
+		for (int x = 0; x < width; x++)
+			gray [x] = qBlue (out [x]);
+		if (target.write ((const char *)gray, width) != width)
+		{
+			fail (tr("Cannot write %1.").arg (target.fileName()));
+			return -1;
+		}
+	}
+
+	if (rowsWritten == height)
+		target.flush();
+	return rowsWritten;
+}
+
+QSize EdgeStream::size() const
+{
+	return QSize (width, height);
+}
+
+int EdgeStream::rowsDone() const
+{
+	return rowsWritten;
+}
+
+QString EdgeStream::errorString() const
+{
+	return error;
+}
+
+bool EdgeStream::fail (const QString &message)
+{
+	error = message;
+	return false;
+}
+
+/*
+	Parse a binary PGM (P5) or PPM (P6) header, leaving the file at the first pixel.
+	Returns false if the file is not one (or uses 16-bit samples).
+*/
+bool EdgeStream::readHeader()
+{
+	char magic [2];
+	if (source.read (magic, 2) != 2 || magic [0] != 'P' || (magic [1] != '5' && magic [1] != '6'))
+		return false;
+	channels = magic [1] == '5' ? 1 : 3;
+
+	int values [3];
+	for (int i = 0; i < 3; i++)
+	{
+		char c;
+		if (!source.getChar (&c))
+			return false;
+		while (c == ' ' || c == '\t' || c == '\r' || c == '\n' || c == '#')
+		{
+			if (c == '#')
+				while (c != '\n' && source.getChar (&c)) {}
+			if (!source.getChar (&c))
+				return false;
+		}
+
+		values [i] = 0;
+		while (c >= '0' && c <= '9')
+		{
+			values [i] = values [i] * 10 + (c - '0');
+			if (!source.getChar (&c))
+				return false;
+		}
+	}
+
+	width = values [0];
+	height = values [1];
+	return values [2] > 0 && values [2] < 256;		// the single whitespace after maxval has been read
+}
+
+// The next source row as luminance.
+bool EdgeStream::readRow (uchar *gray)
+{
+	qint64 bytes = (qint64)channels * width;
+	if (source.read ((char *)raw.data(), bytes) != bytes)
+		return fail (tr("%1 ends before row %2.").arg (sourceName).arg (rowsRead));
+
+	const uchar *in = raw.constData();
+	if (channels == 1)
+		memcpy (gray, in, width);
+	else
+		for (int x = 0; x < width; x++, in += 3)
+			gray [x] = luminance (in [0], in [1], in [2]);
+	return true;
+}
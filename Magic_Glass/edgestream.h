@@ -0,0 +1,54 @@
+/*
+	Edge detection for images too large to hold in memory.
+	The source is read one row at a time and only the rows the operator looks at (3 for Prewitt
+		and Sobel, 5 for LoG) are kept, in a ring buffer of gray rows.  Every finished row goes
+		straight to a binary PGM file, so memory stays proportional to the width whatever the height.
+	Sources: binary PGM/PPM (P5/P6, 8 bits), read sequentially.  Other formats are refused: a Qt
+		reader decoding clip rectangles starts over from the top of the file for every strip,
+		which makes the whole pass quadratic in the height.
+	The caller drives the work with process(), a batch of rows at a time, so it can show progress
+		and stop between batches.  Output pixels match Histo's prewittMask/sobelMask/LoGMask at
+		full resolution, borders included.
+*/
+#ifndef EDGESTREAM_H
+#define EDGESTREAM_H
+
+#include <QtGui>
+
+class EdgeStream
+{
+	Q_DECLARE_TR_FUNCTIONS (EdgeStream)
+
+public:
+	enum Operator {Prewitt, Sobel, LoG};
+
+	EdgeStream();
+	bool open (const QString &input, const QString &output, Operator op);
+	int process (int rows);
+	void close();
+	QSize size() const;
+	int rowsDone() const;
+	QString errorString() const;
+
+private:
+	bool readHeader();
+	bool readRow (uchar *gray);
+	bool fail (const QString &message);
+
+	QFile source;
+	QFile target;
+	QString sourceName;
+	Operator op;
+	int width;
+	int height;
+	int channels;			// 1 (PGM) or 3 (PPM) bytes per pixel
+	int reach;				// rows above and below the operator needs
+	int rowsRead;
+	int rowsWritten;
+	QVector<uchar> ring;	// 2 reach + 1 gray rows; source row r lives in slot r % (2 reach + 1)
+	QVector<uchar> raw;		// one row as stored in the file
+	QVector<QRgb> edges;
+	QVector<uchar> line;
+	QString error;
+};
+#endif
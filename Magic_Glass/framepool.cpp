@@ -0,0 +1,59 @@
+/*
+	The implementation of framepool.h.
+*/
+#include <QtGui>
+#include "framepool.h"
+
+// Return the image held in a slot, reallocating it only if the size or format differs.
+QImage &FramePool::image (Slot slot, const QSize &size, QImage::Format format)
+{
+	QImage &im = images [slot];
+	if (im.size() != size || im.format() != format)
+		im = QImage (size, format);
+	return im;
+}
+
+// Return the image held in a slot as it currently is.
+QImage &FramePool::image (Slot slot)
+{
+	return images [slot];
+}
+
+// Return an 8-bit plane for a slot.  Rows are padded to 16 bytes and storage only ever grows.
+Plane FramePool::plane (Slot slot, const QSize &size)
+{
+	int stride = (size.width() + 15) & ~15;
+	int needed = stride * size.height();
+	if (planes [slot].size() < needed)
+		planes [slot].resize (needed);
+	return Plane (planes [slot].data(), stride, size.width(), size.height());
+}
+
+// Return a 16-bit plane for a slot, sharing the storage of its 8-bit plane.  Rows are padded to 16 bytes.
+Plane16 FramePool::plane16 (Slot slot, const QSize &size)
+{
+	int stride = (2 * size.width() + 15) & ~15;
+	int needed = stride * size.height();
+	if (planes [slot].size() < needed)
+		planes [slot].resize (needed);
+	return Plane16 ((quint16 *)planes [slot].data(), stride, size.width(), size.height());
+}
+
+// Free every buffer (called when the image is closed or replaced).
+void FramePool::release()
+{
+	for (int i = 0; i < SlotCount; i++)
+	{
+		images [i] = QImage();
+		planes [i] = QVector<uchar>();
+	}
+}
+
+// Total number of bytes currently held by the pool.
+qint64 FramePool::bytes() const
+{
+	qint64 total = 0;
+	for (int i = 0; i < SlotCount; i++)
+		total += (qint64)images [i].byteCount() + planes [i].size();
+	return total;
+}
@@ -0,0 +1,29 @@
+/*
+	A small pool of reusable frame buffers owned by ImagePanel.
+	Each slot keeps its buffer alive between frames and only reallocates when the requested
+		size or format changes (zoom, new image), so the lens and edge paths run without
+		touching the heap in steady state.
+*/
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include <QtGui>
+#include "imageview.h"
+
+class FramePool
+{
+public:
+	enum Slot {Scaled, Lens, Edge, Gray, Median, Mask, SlotCount};
+
+	QImage &image (Slot slot, const QSize &size, QImage::Format format = QImage::Format_RGB32);
+	QImage &image (Slot slot);
+	Plane plane (Slot slot, const QSize &size);
+	Plane16 plane16 (Slot slot, const QSize &size);
+	void release();
+	qint64 bytes() const;
+
+private:
+	QImage images [SlotCount];
+	QVector<uchar> planes [SlotCount];
+};
+#endif
@@ -3,13 +3,17 @@
 	The implementation of histo.h.
 */
 #include <QtGui>
+#include <cmath>
 #include "histo.h"
+#include "pixelaccess.h"
+#include "rowkernels.h"
 
 //	Constructor: initializes variables and setting all histogram variables to zero.
 Histo::Histo(QWidget *parent, Qt::WFlags f)
 	: QWidget (parent, f)
 {
 	red = green = blue = aveGS = lumGS = thresAll = thresInd = false;
+	chan = Red;
 	thresValue = 0;
 	redHisto = new int [256];
 	greenHisto = new int [256];
@@ -22,41 +26,669 @@ Histo::Histo(QWidget *parent, Qt::WFlags f)
 		blueHisto [i] = 0;
 	}
 
+	ready = true;
+	approximate = false;
+	samples = pixels = 0;
+	watcher = new QFutureWatcher<HistoStatistics> (this);
+	connect (watcher, SIGNAL(finished()), this, SLOT(calcFinished()));
+
+	claheValid = false;
 	lookUpTable (0);
+	equalizeTables();
+}
+
+//	Destructor
+Histo::~Histo()
+{
+	cancelCalc();
+	delete [] redHisto;
+	delete [] greenHisto;
+	delete [] blueHisto;
+}
+
+namespace
+{
+	// The image itself if pixelaccess.h can read its format, otherwise a 32-bit copy.
+	QImage readable (const QImage &image)
+	{
+		return ImageView::supports (image) ? image : image.convertToFormat (QImage::Format_RGB32);
+	}
+
+	// Columns [x0, x1] of lens row j that lie inside the disc of squared radius rad2 centered on (x, y); false if none do.
+	bool discSpan (const QRect &lens, int rad2, int x, int y, int j, int &x0, int &x1)
+	{
+		int rest = rad2 - (j - y) * (j - y);
+		if (rest < 0)
+			return false;
+
+		int half = (int)std::sqrt ((double)rest);
+		while ((half + 1) * (half + 1) <= rest)
+			half++;
+		while (half * half > rest)
+			half--;
+
+		x0 = qMax (lens.left(), x - half);
+		x1 = qMin (lens.right(), x + half);
+		return x0 <= x1;
+	}
+
+	// Put back the part of the lens drawn last time (previous) that lies in bounds, from the frame src.
+	void restoreLens (const ImageView &src, QImage &dst, const QRect &previous, const QRect &bounds)
+	{
+		QRect old = previous & bounds;
+		for (int j = old.top(); j <= old.bottom(); j++)
+			memcpy (dst.scanLine (j) + old.left() * 4, src.scanLine (j) + old.left() * 4, old.width() * 4);
+	}
+
+	// Counts rows [first, last) of a source in its native format into band.
+	struct CountRows
+	{
+		CountRows (int f, int l, const QAtomicInt *c, HistoStatistics &b) : first (f), last (l), cancel (c), band (b) {}
+
+		template <class Pixels>
+		void operator() (const ImageView &src, const Pixels &pixels)
+		{
+			QVector<QRgb> row (src.width);
+			QRgb *out = row.data();
+
+			for (int y = first; y < last; y++)
+			{
+				if (cancel && int (*cancel))
+				{
+					band.cancelled = true;
+					break;
+				}
+
+				const uchar *line = src.scanLine (y);
+				for (int x = 0; x < src.width; x++)
+				{
+					QRgb c = pixels (line, x);
+					band.red [qRed (c)]++;
+					band.green [qGreen (c)]++;
+					band.blue [qBlue (c)]++;
+					out [x] = c;
+				}
+				band.colors.addLine (out, src.width);
+			}
+		}
+
+		int first;
+		int last;
+		const QAtomicInt *cancel;
+		HistoStatistics &band;
+	};
+
+	// Counts one row band; bands run in parallel and are summed afterwards.
+	struct BandStatistics
+	{
+		typedef HistoStatistics result_type;
+
+		BandStatistics (const ImageView &s, QSharedPointer<QAtomicInt> c) : source (s), cancel (c) {}
+
+		HistoStatistics operator() (const QPair<int, int> &rows) const
+		{
+			HistoStatistics band;
+			memset (band.red, 0, sizeof (band.red));
+			memset (band.green, 0, sizeof (band.green));
+			memset (band.blue, 0, sizeof (band.blue));
+			band.cancelled = false;
+
+			CountRows count (rows.first, rows.second, cancel.data(), band);
+			dispatchPixels (source, count);
+			return band;
+		}
+
+		ImageView source;
+		QSharedPointer<QAtomicInt> cancel;
+	};
+
+	/*
+		Counts one row band of a 16-bit source into its 65536-bin tables.  Bands run in parallel
+			and are summed afterwards, like BandStatistics.
+	*/
+	struct DeepBandStatistics
+	{
+		typedef HistoStatistics result_type;
+
+		DeepBandStatistics (const ImageView &s, QSharedPointer<QAtomicInt> c) : source (s), cancel (c) {}
+
+		HistoStatistics operator() (const QPair<int, int> &rows) const
+		{
+			HistoStatistics band;
+			band.cancelled = false;
+			band.deep.fill (0, source.layout == ImageView::Gray16 ? 65536 : 3 * 65536);
+			int *counts = band.deep.data();
+
+			for (int y = rows.first; y < rows.second; y++)
+			{
+				if (cancel && int (*cancel))
+				{
+					band.cancelled = true;
+					break;
+				}
+
+				const quint16 *line = (const quint16 *)source.scanLine (y);
+				if (source.layout == ImageView::Gray16)
+					for (int x = 0; x < source.width; x++)
+						counts [line [x]]++;
+				else
+					for (int x = 0; x < source.width; x++)
+					{
+						counts [line [3 * x]]++;
+						counts [65536 + line [3 * x + 1]]++;
+						counts [2 * 65536 + line [3 * x + 2]]++;
+					}
+			}
+			return band;
+		}
+
+		ImageView source;
+		QSharedPointer<QAtomicInt> cancel;
+	};
+
+	/*
+		Stratified sample for estimate(): the rows are cut into edges.size() - 1 equal strata, and
+			each stratum gets perStratum pixels, every one at its own random row in the stratum and
+			random column.  The pixels are drawn independently, not as whole rows, so the
+			binomial interval of margin() holds however much neighbouring pixels are alike.
+	*/
+	struct SamplePixels
+	{
+		SamplePixels (const QVector<int> &e, int n, quint32 p, HistoStatistics &s) : edges (e), perStratum (n), seed (p), stats (s) {}
+
+		template <class Pixels>
+		void operator() (const ImageView &src, const Pixels &pixels)
+		{
+			for (int s = 0; s + 1 < edges.size(); s++)
+			{
+				quint32 height = edges [s + 1] - edges [s];
+				for (int k = 0; k < perStratum; k++)
+				{
+					seed = seed * 1664525 + 1013904223;
+					int y = edges [s] + (int)((seed >> 8) % height);
+					seed = seed * 1664525 + 1013904223;
+					int x = (int)((seed >> 8) % (quint32)src.width);
+					QRgb c = pixels (src.scanLine (y), x);
+					stats.red [qRed (c)]++;
+					stats.green [qGreen (c)]++;
+					stats.blue [qBlue (c)]++;
+					stats.samples++;
+				}
+			}
+		}
+
+		const QVector<int> &edges;
+		int perStratum;
+		quint32 seed;
+		HistoStatistics &stats;
+	};
+
+	// Nearest-neighbour scaling with 16.16 fixed-point steps, 64 bits wide so sources of 32768 pixels and more do not overflow.
+	struct ScaleRows
+	{
+		explicit ScaleRows (QImage &d) : dst (d) {}
+
+		template <class Pixels>
+		void operator() (const ImageView &src, const Pixels &pixels)
+		{
+			qint64 stepX = ((qint64)src.width << 16) / dst.width();
+			qint64 stepY = ((qint64)src.height << 16) / dst.height();
+
+			qint64 fy = 0;
+			for (int y = 0; y < dst.height(); y++, fy += stepY)
+			{
+				const uchar *in = src.scanLine ((int)(fy >> 16));
+				QRgb *out = (QRgb *)dst.scanLine (y);
+				qint64 fx = 0;
+				for (int x = 0; x < dst.width(); x++, fx += stepX)
+					out [x] = pixels (in, (int)(fx >> 16));
+			}
+		}
+
+		QImage &dst;
+	};
+
+	// Threshold mask: 255 where the pixel is bright (luminance, or any band for individual), else 0.
+	struct ThresholdRows
+	{
+		ThresholdRows (const Plane &d, const uchar *l, bool i) : dst (d), lut (l), individual (i) {}
+
+		template <class Pixels>
+		void operator() (const ImageView &src, const Pixels &pixels)
+		{
+			for (int y = 0; y < dst.height; y++)
+			{
+				const uchar *in = src.scanLine (y);
+				uchar *out = dst.scanLine (y);
+				for (int x = 0; x < dst.width; x++)
+				{
+					QRgb c = pixels (in, x);
+					if (individual)
+						out [x] = lut [qRed (c)] | lut [qGreen (c)] | lut [qBlue (c)];
+					else
+						out [x] = lut [luminance (qRed (c), qGreen (c), qBlue (c))];
+				}
+			}
+		}
+
+		const Plane &dst;
+		const uchar *lut;
+		bool individual;
+	};
+
+	/*
+		Threshold mask of a 16-bit source at full precision: 255 where the sample (gray), its
+			16-bit luminance or, for individual, any of its bands is at least cut.
+	*/
+	void thresholdDeep (const ImageView &src, const Plane &dst, int cut, bool individual)
+	{
+		for (int y = 0; y < dst.height; y++)
+		{
+			const quint16 *in = (const quint16 *)src.scanLine (y);
+			uchar *out = dst.scanLine (y);
+			if (src.layout == ImageView::Gray16)
+				for (int x = 0; x < dst.width; x++)
+					out [x] = in [x] >= cut ? 255 : 0;
+			else if (individual)
+				for (int x = 0; x < dst.width; x++)
+					out [x] = in [3 * x] >= cut || in [3 * x + 1] >= cut || in [3 * x + 2] >= cut ? 255 : 0;
+			else
+				for (int x = 0; x < dst.width; x++)
+					out [x] = luminance (in [3 * x], in [3 * x + 1], in [3 * x + 2]) >= cut ? 255 : 0;
+		}
+	}
+
+	// Luminance of every pixel into an 8-bit plane of the same size.
+	struct GrayRows
+	{
+		explicit GrayRows (const Plane &d) : dst (d) {}
+
+		template <class Pixels>
+		void operator() (const ImageView &src, const Pixels &pixels)
+		{
+			for (int y = 0; y < dst.height; y++)
+			{
+				const uchar *in = src.scanLine (y);
+				uchar *out = dst.scanLine (y);
+				for (int x = 0; x < dst.width; x++)
+				{
+					QRgb c = pixels (in, x);
+					out [x] = luminance (qRed (c), qGreen (c), qBlue (c));
+				}
+			}
+		}
+
+		const Plane &dst;
+	};
 }
 
 /*
-	This function get called from open() of MainWindow.
-	This function calculate the histogram of an image, which passed from open()
+	Calculate the histogram of an image and the joint RGB histogram used to report the frequency
+		of an exact color.  Row bands are counted in parallel, reading the image in its own format
+		(formats pixelaccess.h has no reader for are converted to 32-bit first).  The cancel flag, when given, is polled
+		once per row so a superseded calculation stops quickly; the result is then marked cancelled.
 */
-void Histo::histoCalc (QImage image)
+HistoStatistics Histo::statistics (QImage image, QSharedPointer<QAtomicInt> cancel)
 {
-	for (int j = 0; j < image.height(); j++)
+	image = readable (image);
+	return viewStatistics (ImageView (image), cancel);
+}
+
+//	statistics() of an 8-bit source in any layout pixelaccess.h reads; its pixels must stay valid until it returns.
+HistoStatistics Histo::viewStatistics (ImageView source, QSharedPointer<QAtomicInt> cancel)
+{
+	int bands = qMin (QThread::idealThreadCount() * 2, source.height);
+	QList<QPair<int, int> > rows;
+	for (int b = 0; b < bands; b++)
+		rows << qMakePair (source.height * b / bands, source.height * (b + 1) / bands);
+
+	QList<HistoStatistics> parts = QtConcurrent::blockingMapped<QList<HistoStatistics> > (rows, BandStatistics (source, cancel));
+
+	HistoStatistics total;
+	memset (total.red, 0, sizeof (total.red));
+	memset (total.green, 0, sizeof (total.green));
+	memset (total.blue, 0, sizeof (total.blue));
+	total.cancelled = false;
+	total.pixels = total.samples = (qint64)source.width * source.height;
+
+	for (int b = 0; b < parts.size(); b++)
 	{
-		for (int k = 0; k < image.width(); k++)
+		for (int i = 0; i < 256; i++)
 		{
-			color = image.pixel (k, j);
-
-			redHisto [qRed(color)]++;
-			greenHisto [qGreen(color)]++;
-			blueHisto [qBlue(color)]++;
+			total.red [i] += parts [b].red [i];
+			total.green [i] += parts [b].green [i];
+			total.blue [i] += parts [b].blue [i];
 		}
+		total.colors.merge (parts [b].colors);
+		total.cancelled |= parts [b].cancelled;
 	}
+	return total;
 }
 
-// Generate a 3-bands histogram and save it a file that the user specified.
-// File format has been preset to JPG format.
-void Histo::drawHisto(const QString &fileName)
+/*
+	Estimate the histograms of a large image from a stratified sample of 512 x 512 pixels
+		(see SamplePixels), which takes a few milliseconds at any image size.  The counts are the
+		sample counts; install() scales them up and showHisto() reports their 95% confidence
+		intervals.  Images of up to four times the sample size are counted exactly instead.
+*/
+HistoStatistics Histo::estimate (const QImage &source)
 {
-	QImage histogram (256, 256, QImage::Format_RGB32);
+	QImage image = readable (source);
+	return estimate (ImageView (image));
+}
+
+// estimate() of an 8-bit source in any layout pixelaccess.h reads.
+HistoStatistics Histo::estimate (const ImageView &source)
+{
+	const int sampleRows = 512;
+	const int sampleColumns = 512;
+
+	HistoStatistics stats;
+	memset (stats.red, 0, sizeof (stats.red));
+	memset (stats.green, 0, sizeof (stats.green));
+	memset (stats.blue, 0, sizeof (stats.blue));
+	stats.cancelled = false;
+	stats.pixels = (qint64)source.width * source.height;
+	stats.samples = 0;
+
+	if (stats.pixels <= 4 * (qint64)sampleRows * sampleColumns)
+		return viewStatistics (source, QSharedPointer<QAtomicInt>());
+
+	int strata = qMin (sampleRows, source.height);
+	QVector<int> edges (strata + 1);
+	for (int s = 0; s <= strata; s++)
+		edges [s] = (int)((qint64)source.height * s / strata);
+
+	SamplePixels sample (edges, (int)((qint64)sampleRows * sampleColumns / strata), 2166136261u, stats);
+	dispatchPixels (source, sample);
+	return stats;
+}
+
+/*
+	Count a 16-bit source into 65536 bins per band.  Row bands are counted in parallel as in
+		statistics(), but only one per thread, since each holds its own tables.
+*/
+HistoStatistics Histo::deepStatistics (ImageView source, QSharedPointer<QAtomicInt> cancel)
+{
+	int bands = qMin (QThread::idealThreadCount(), source.height);
+	QList<QPair<int, int> > rows;
+	for (int b = 0; b < bands; b++)
+		rows << qMakePair (source.height * b / bands, source.height * (b + 1) / bands);
+
+	QList<HistoStatistics> parts = QtConcurrent::blockingMapped<QList<HistoStatistics> > (rows, DeepBandStatistics (source, cancel));
+
+	HistoStatistics total;
+	memset (total.red, 0, sizeof (total.red));
+	memset (total.green, 0, sizeof (total.green));
+	memset (total.blue, 0, sizeof (total.blue));
+	total.cancelled = false;
+	total.pixels = total.samples = (qint64)source.width * source.height;
+	total.deep.fill (0, source.layout == ImageView::Gray16 ? 65536 : 3 * 65536);
+
+	int *sum = total.deep.data();
+	for (int b = 0; b < parts.size(); b++)
+	{
+		const int *part = parts [b].deep.constData();
+		for (int i = 0; i < total.deep.size(); i++)
+			sum [i] += part [i];
+		total.cancelled |= parts [b].cancelled;
+	}
+	return total;
+}
+
+//	Calculate the statistics of an image right away, replacing any calculation still running.
+void Histo::histoCalc (const QImage &image)
+{
+	cancelCalc();
+	install (statistics (image, QSharedPointer<QAtomicInt>()));
+}
+
+/*
+	Start calculating the statistics of an image on a worker thread.  Until statisticsReady() is
+		emitted, the histograms hold an estimate (see estimate()), which showHisto() reports with
+		its confidence intervals.
+*/
+void Histo::startCalc (const QImage &image)
+{
+	cancelCalc();
+	HistoStatistics sample = estimate (image);
+	install (sample);
+	if (sample.samples == sample.pixels)
+		return;
+
+	cancel = QSharedPointer<QAtomicInt> (new QAtomicInt (0));
+	watcher -> setFuture (QtConcurrent::run (&Histo::statistics, image, cancel));
+}
+
+/*
+	Start calculating the statistics of a source the caller keeps valid (a mapped file) until the
+		calculation is finished or cancelled.  8-bit sources are estimated first, as above.
+	A 16-bit source is counted right away: counting it is as fast as sampling it, so there is no
+		estimate and the histograms stay empty until statisticsReady().
+*/
+void Histo::startCalc (const ImageView &source)
+{
+	cancelCalc();
+	if (!source.isDeep())
+	{
+		HistoStatistics sample = estimate (source);
+		install (sample);
+		if (sample.samples == sample.pixels)
+			return;
+
+		cancel = QSharedPointer<QAtomicInt> (new QAtomicInt (0));
+		watcher -> setFuture (QtConcurrent::run (&Histo::viewStatistics, source, cancel));
+		return;
+	}
+
+	displayLevels = source.window;
+	deepCounts.clear();
+	memset (redHisto, 0, 256 * sizeof (int));
+	memset (greenHisto, 0, 256 * sizeof (int));
+	memset (blueHisto, 0, 256 * sizeof (int));
+	equalizeTables();
+
+	cancel = QSharedPointer<QAtomicInt> (new QAtomicInt (0));
+	watcher -> setFuture (QtConcurrent::run (&Histo::deepStatistics, source, cancel));
+}
+
+//	The display window of the 16-bit source changed: bin its counts again by the new levels.
+void Histo::setWindow (const ImageView &source)
+{
+	displayLevels = source.window;
+	if (!deepCounts.isEmpty())
+		binDeep();
+}
+
+//	Stop a running calculation; the current values no longer describe the shown image.
+void Histo::cancelCalc()
+{
+	if (cancel)
+		cancel -> fetchAndStoreOrdered (1);
+	cancel.clear();
+	ready = false;
+	approximate = false;
+}
+
+// Block until a cancelled calculation has stopped reading its image.
+void Histo::waitForCalc()
+{
+	watcher -> waitForFinished();
+}
+
+// Whether the exact statistics are in.
+bool Histo::isReady() const
+{
+	return ready;
+}
+
+// Whether the histograms hold an estimate while the exact statistics are calculated.
+bool Histo::isEstimate() const
+{
+	return approximate;
+}
+
+// The 256 counts of the red, green or blue histogram (for a 16-bit source, of its display levels).
+QVector<int> Histo::counts (Channel channel) const
+{
+	const int *histo = channel == Green ? greenHisto : channel == Blue ? blueHisto : redHisto;
+	QVector<int> values (256);
+	memcpy (values.data(), histo, 256 * sizeof (int));
+	return values;
+}
+
+void Histo::calcFinished()
+{
+	HistoStatistics stats = watcher -> result();
+	if (stats.cancelled || !cancel)
+		return;
+
+	cancel.clear();
+	install (stats);
+	emit statisticsReady();
+}
+
+/*
+	Take over counted statistics.  An estimate is scaled up to the size of the image and its
+		sample counts are kept for margin(); it also drives the equalization until the exact
+		statistics replace it.  The counts of a 16-bit source are kept whole and binned.
+*/
+void Histo::install (const HistoStatistics &stats)
+{
+	deepCounts = stats.deep;
+	if (!deepCounts.isEmpty())
+	{
+		colors = ColorTable();
+		approximate = false;
+		ready = true;
+		samples = pixels = stats.pixels;
+		binDeep();
+		return;
+	}
+
+	memcpy (redHisto, stats.red, sizeof (stats.red));
+	memcpy (greenHisto, stats.green, sizeof (stats.green));
+	memcpy (blueHisto, stats.blue, sizeof (stats.blue));
+	colors = stats.colors;
+	approximate = stats.samples < stats.pixels;
+	ready = !approximate;
+	samples = stats.samples;
+	pixels = stats.pixels;
+
+	if (approximate)
+	{
+		memcpy (sampled [0], stats.red, sizeof (stats.red));
+		memcpy (sampled [1], stats.green, sizeof (stats.green));
+		memcpy (sampled [2], stats.blue, sizeof (stats.blue));
+		int *histos [3] = {redHisto, greenHisto, blueHisto};
+		for (int band = 0; band < 3; band++)
+			for (int v = 0; v < 256; v++)
+				histos [band][v] = (int)((sampled [band][v] * pixels + samples / 2) / samples);
+	}
+	equalizeTables();
+}
+
+/*
+	Half width, in pixels of the whole image, of the 95% Wilson score interval of an estimated
+		count: the sampled share p = k / n of the level is widened by
+		z / (1 + z^2 / n) * sqrt (p (1 - p) / n + z^2 / 4n^2), with z = 1.96.
+	It takes the n sampled pixels as independent draws, which SamplePixels makes them.  Strata of
+		equal size with equal numbers of draws only lower the variance, so the interval errs on
+		the safe side.
+*/
+int Histo::margin (int band, int level) const
+{
+	const double z = 1.96;
+	double n = (double)samples;
+	double p = sampled [band][level] / n;
+	double half = z / (1 + z * z / n) * std::sqrt (p * (1 - p) / n + z * z / (4 * n * n));
+	return (int)std::ceil (half * pixels);
+}
 
-	for (int h = 0; h < histogram.height(); h++)
+/*
+	Global histogram equalization of each band, from the histograms just installed: level v maps
+		to 255 (cdf (v) - cdf (first used level)) / (pixels - cdf (first used level)).
+	With no pixels (no image yet) the tables are the identity.
+*/
+void Histo::equalizeTables()
+{
+	const int *histos [3] = {redHisto, greenHisto, blueHisto};
+	for (int band = 0; band < 3; band++)
 	{
-		for (int w = 0; w < histogram.width(); w++)
+		const int *histo = histos [band];
+		qint64 total = 0;
+		for (int v = 0; v < 256; v++)
+			total += histo [v];
+
+		qint64 lowest = 0;
+		for (int v = 0; v < 256 && !lowest; v++)
+			lowest = histo [v];
+
+		qint64 sum = 0;
+		for (int v = 0; v < 256; v++)
 		{
-			histogram.setPixel (w, h, qRgb (255, 255, 255));
+			sum += histo [v];
+			if (total <= lowest)
+				equalized [band][v] = v;
+			else
+				equalized [band][v] = (uchar)qBound ((qint64)0, ((sum - lowest) * 255 + (total - lowest) / 2) / (total - lowest), (qint64)255);
 		}
 	}
+}
+
+/*
+	The binned view of a 16-bit source: its 65536-bin counts summed by the display level each
+		sample is shown at, so the 256-level histograms, their equalization and drawHisto()
+		describe what is on screen.
+*/
+void Histo::binDeep()
+{
+	int *histos [3] = {redHisto, greenHisto, blueHisto};
+	int bands = deepCounts.size() / 65536;
+	for (int band = 0; band < 3; band++)
+	{
+		int *histo = histos [band];
+		const int *counts = deepCounts.constData() + 65536 * qMin (band, bands - 1);
+		memset (histo, 0, 256 * sizeof (int));
+		for (int v = 0; v < 65536; v++)
+			histo [displayLevels [v]] += counts [v];
+	}
+	equalizeTables();
+}
+
+// Bytes held by the joint RGB histogram and the 16-bit counts; they stay until the next image is counted.
+qint64 Histo::statisticsBytes() const
+{
+	return colors.bytes() + (qint64)deepCounts.size() * sizeof (int);
+}
+
+// Bytes held by the cached color-space and CLAHE planes and the magnified lens, which releasePlanes() drops.
+qint64 Histo::cacheBytes() const
+{
+	return colorPlanes.bytes() + clahe.bytes() + claheGray.size() + claheOut.size()
+		 + magnifier.bytes() + lensPlanes.bytes() + lensGray.size() + lensClahe.size();
+}
+
+// Drop the cached color-space and CLAHE planes and the magnified lens buffers; they are computed again when next needed.
+void Histo::releasePlanes()
+{
+	colorPlanes.release();
+	clahe.release();
+	claheGray = QVector<uchar>();
+	claheOut = QVector<uchar>();
+	claheValid = false;
+	magnifier.release();
+	lensPlanes.release();
+	lensGray = QVector<uchar>();
+	lensClahe = QVector<uchar>();
+}
+
+// Generate a 3-bands histogram and save it a file that the user specified.
+// File format has been preset to JPG format.
+void Histo::drawHisto(const QString &fileName)
+{
+	QImage histogram (256, 256, QImage::Format_RGB32);
+	histogram.fill (qRgb (255, 255, 255));
 
 	maxRed = redHisto[0];
 	for (int r = 1; r < 256; r++)
@@ -93,109 +725,464 @@ void Histo::drawHisto(const QString &fileName)
 	{
 		rPosition = redHisto[c] / scale;
 		rPosition = histogram.height() - rPosition - 1;
-		histogram.setPixel (c, rPosition, qRgb (255, 0, 0));
+		((QRgb *)histogram.scanLine (rPosition)) [c] = qRgb (255, 0, 0);
 
 		gPosition = greenHisto[c] / scale;
 		gPosition = histogram.height() - gPosition - 1;
-		histogram.setPixel (c, gPosition, qRgb (0, 255, 0));
+		((QRgb *)histogram.scanLine (gPosition)) [c] = qRgb (0, 255, 0);
 
 		bPosition = blueHisto[c] / scale;
 		bPosition = histogram.height() - bPosition - 1;
-		histogram.setPixel (c, bPosition, qRgb (0, 0, 255));
+		((QRgb *)histogram.scanLine (bPosition)) [c] = qRgb (0, 0, 255);
 	}
 
 	histogram.save (fileName, "jpg");
 }
 
-//	Show the histogram at indexes r, g, b, which is really the RGB values.
+/*
+	Show the histogram at indexes r, g, b, which is really the RGB values, and the count of that exact color.
+	An estimate is shown with its margins; the exact color count waits for the exact statistics.
+	For a 16-bit source r, g and b are its samples and the counts come from the 65536-bin tables;
+		there is no joint count of 16-bit colors (-1), but a gray sample's count is its color's.
+*/
 void Histo::showHisto (int r, int g, int b)
 {
+	if (approximate)
+	{
+		emit histoPending();
+		emit histoEstimate (redHisto [r], greenHisto [g], blueHisto [b], margin (0, r), margin (1, g), margin (2, b));
+		return;
+	}
+	if (!ready)
+	{
+		emit histoPending();
+		return;
+	}
+
+	if (!deepCounts.isEmpty())
+	{
+		int band = deepCounts.size() > 65536 ? 65536 : 0;
+		emit histoValue (deepCounts [r], deepCounts [band + g], deepCounts [2 * band + b]);
+		emit colorFrequency (band ? -1 : deepCounts [r]);
+		return;
+	}
+
 	emit histoValue (redHisto [r], greenHisto [g], blueHisto [b]);
+	emit colorFrequency (colors.count (qRgb (r, g, b)));
 }
 
 // A look-up table for thresholding.  0 ~ thresLevel is 0... thresLevel ~ 255 is 255.
+// The table lives inside Histo, so changing the level never allocates.
 void Histo::lookUpTable (int thresLevel)
 {
-	lut = new int [256];
 	int i;
 
-	for (i = 0; i < thresLevel; i++)
+	for (i = 0; i < thresLevel && i < 256; i++)
 		lut [i] = 0;
-	for (		  ; i < 255; i++)
+	for (		  ; i < 256; i++)
 		lut [i] = 255;
 }
 
 /*
-	Magic Glass function.  Obtain current coordinates from ImagePanel and only process the image within the ellipse's radius.
-	Using enum to decide which channel(red, green, blue, grayscales, or threshold) to process.
+	Magic Glass function (QImage convenience form).
+	Scales the original to the size of copy and runs the lens kernel over a fresh image.
+*/
+QImage Histo::magicGlass (const QImage &orig, const QImage &copy, int rad, int x, int y)
+{
+	QImage src (copy.size(), QImage::Format_RGB32);
+	scaleImage (ImageView (readable (orig)), src);
+	QImage newPic = src.copy();
+	magicGlass (ImageView (src), newPic, QRect(), rad, x, y);
+	return newPic;
+}
+
+/*
+	Magic Glass kernel.  src and dst are 32-bit display buffers (see scaleImage).  dst must hold a copy of src everywhere outside the lens drawn last time;
+		previous is the rectangle returned by the last call, which is restored from src before
+		the new lens is drawn.  Only the rows and spans inside the circle are visited.
+	Using enum to decide which channel(red, green, blue, grayscales, threshold, or color space) to process.
+	Color-space and CLAHE channels copy spans out of the planes cached for src, computed on first use.
+	A step above 1 draws the interactive-quality lens of coarseLens().
+	Returns the bounding rectangle of the lens just drawn.
+*/
+QRect Histo::magicGlass (const ImageView &src, QImage &dst, const QRect &previous, int rad, int x, int y, int step)
+{
+	QRect bounds (0, 0, qMin (src.width, dst.width()), qMin (src.height, dst.height()));
+	restoreLens (src, dst, previous, bounds);
+
+	QRect lens = QRect (x - rad, y - rad, 2 * rad + 1, 2 * rad + 1) & bounds;
+	int rad2 = rad * rad;
+
+	// Threshold views with morphology: filter the lens square, padded by the element's reach, first.
+	// The coarse lens leaves the morphology out; it is put back when the lens is refined.
+	bool filtered = step == 1 && (chan == All || chan == Ind) && morphology.operation() != Morphology::None && !lens.isEmpty();
+	QRect region;
+	if (filtered)
+	{
+		int reach = morphology.reach();
+		region = lens.adjusted (-reach, -reach, reach, reach) & bounds;
+		thresholdRegion (src, region);
+	}
+
+	Plane space;
+	if (chan == Adaptive && !lens.isEmpty())
+		space = clahePlane (src);
+	else if (chan >= Hue && chan <= BStar && !lens.isEmpty())
+		space = channelPlane (chan, src);
+
+	if (step > 1)
+	{
+		coarseLens (src, dst, space, lens, rad2, x, y, step);
+		return lens;
+	}
+
+	for (int j = lens.top(); j <= lens.bottom(); j++)
+	{
+		int x0, x1;
+		if (!discSpan (lens, rad2, x, y, j, x0, x1))
+			continue;
+
+		const QRgb *in = (const QRgb *)src.scanLine (j);
+		QRgb *out = (QRgb *)dst.scanLine (j);
+		if (filtered)
+			maskSpan (region, j, x0, out + x0, x1 - x0 + 1);
+		else if (!space.isNull())
+		{
+			const uchar *v = space.scanLine (j);
+			for (int i = x0; i <= x1; i++)
+				out [i] = qRgb (v [i], v [i], v [i]);
+		}
+		else
+			lensSpan (in + x0, out + x0, x1 - x0 + 1);
+	}
+
+	return lens;
+}
+
+/*
+	Magnifying Magic Glass.  Like magicGlass(), but the lens shows the full-resolution source
+		(any layout; see Magnifier) magnification times larger than the frame src around it,
+		resampled for just the lens at the size it is drawn, centered on the source point under
+		(x, y).  The channel views run on the resampled pixels, so their cost follows the radius
+		alone.  Morphology and the color-space and CLAHE channels need the whole lens square (plus
+		the reach of the element): it is resampled, and its color-space planes and CLAHE are
+		computed again, every frame.  CLAHE is then local to the lens.
+*/
+QRect Histo::magnifiedGlass (const ImageView &source, const ImageView &src, QImage &dst, const QRect &previous, int rad, int x, int y, double magnification)
+{
+	QRect bounds (0, 0, qMin (src.width, dst.width()), qMin (src.height, dst.height()));
+	restoreLens (src, dst, previous, bounds);
+
+	QRect lens = QRect (x - rad, y - rad, 2 * rad + 1, 2 * rad + 1) & bounds;
+	if (lens.isEmpty() || source.isNull())
+		return lens;
+	int rad2 = rad * rad;
+
+	bool filtered = (chan == All || chan == Ind) && morphology.operation() != Morphology::None;
+	bool planes = (chan >= Hue && chan <= BStar) || chan == Adaptive;
+	QRect area = filtered ? lens.adjusted (-morphology.reach(), -morphology.reach(), morphology.reach(), morphology.reach()) : lens;
+
+	lensRows.resize (2 * area.height());
+	for (int j = area.top(); j <= area.bottom(); j++)
+	{
+		int x0 = area.left(), x1 = area.right();
+		if (!filtered && !planes && !discSpan (lens, rad2, x, y, j, x0, x1))
+			x1 = x0 - 1;
+		lensRows [2 * (j - area.top())] = x0 - area.left();
+		lensRows [2 * (j - area.top()) + 1] = x1 - area.left();
+	}
+
+	// Frame pixel (i, j) shows source pixel ((i + 0.5) * fx - 0.5, ...); the lens shows the points around the center magnification times closer.
+	double fx = (double)source.width / src.width;
+	double fy = (double)source.height / src.height;
+	QPointF step (fx / magnification, fy / magnification);
+	QPointF origin ((x + 0.5) * fx - 0.5 + (area.left() - x) * step.x(), (y + 0.5) * fy - 0.5 + (area.top() - y) * step.y());
+	ImageView magnified = magnifier.resample (source, area.size(), origin, step, lensRows);
+	if (magnified.isNull())
+		return QRect();
+
+	if (filtered)
+		thresholdRegion (magnified, QRect (QPoint (0, 0), area.size()));
+
+	Plane space;
+	if (chan == Adaptive)
+	{
+		int size = area.width() * area.height();
+		lensGray.resize (size);
+		lensClahe.resize (size);
+		grayPlane (magnified, Plane (lensGray.data(), area.width(), area.width(), area.height()));
+		space = Plane (lensClahe.data(), area.width(), area.width(), area.height());
+		clahe.apply (Plane (lensGray.data(), area.width(), area.width(), area.height()), space);
+	}
+	else if (planes)
+	{
+		lensPlanes.invalidate();
+		space = lensPlanes.plane (ColorPlanes::Channel (chan - Hue), magnified);
+	}
+
+	for (int j = lens.top(); j <= lens.bottom(); j++)
+	{
+		int x0, x1;
+		if (!discSpan (lens, rad2, x, y, j, x0, x1))
+			continue;
+
+		QRgb *out = (QRgb *)dst.scanLine (j);
+		if (filtered)
+			maskSpan (area, j, x0, out + x0, x1 - x0 + 1);
+		else if (!space.isNull())
+		{
+			const uchar *v = space.scanLine (j - area.top()) + (x0 - area.left());
+			for (int i = 0; i <= x1 - x0; i++)
+				out [x0 + i] = qRgb (v [i], v [i], v [i]);
+		}
+		else
+			lensSpan ((const QRgb *)magnified.scanLine (j - area.top()) + (x0 - area.left()), out + x0, x1 - x0 + 1);
+	}
+
+	return lens;
+}
+
+// Bilinear or bicubic resampling for magnifiedGlass().
+void Histo::setInterpolation (Magnifier::Interpolation interpolation)
+{
+	magnifier.setInterpolation (interpolation);
+}
+
+/*
+	Interactive-quality lens: only every step-th pixel of every step-th row of the lens square goes
+		through the channel and is repeated over its step x step block, so the work per frame falls
+		with the square of step.  The disc outline is still cut at full resolution.
 */
-QImage Histo::magicGlass (QImage orig, QImage copy, int rad, int x, int y)
+void Histo::coarseLens (const ImageView &src, QImage &dst, const Plane &space, const QRect &lens, int rad2, int x, int y, int step)
+{
+	int n = (lens.width() + step - 1) / step;
+	spans.resize (2 * n);
+	QRgb *sampled = spans.data();
+	QRgb *processed = sampled + n;
+
+	for (int top = lens.top(); top <= lens.bottom(); top += step)
+	{
+		if (!space.isNull())
+		{
+			const uchar *v = space.scanLine (top) + lens.left();
+			for (int k = 0; k < n; k++)
+				processed [k] = qRgb (v [k * step], v [k * step], v [k * step]);
+		}
+		else
+		{
+			const QRgb *in = (const QRgb *)src.scanLine (top) + lens.left();
+			for (int k = 0; k < n; k++)
+				sampled [k] = in [k * step];
+			lensSpan (sampled, processed, n);
+		}
+
+		int bottom = qMin (top + step - 1, lens.bottom());
+		for (int j = top; j <= bottom; j++)
+		{
+			int x0, x1;
+			if (!discSpan (lens, rad2, x, y, j, x0, x1))
+				continue;
+
+			QRgb *out = (QRgb *)dst.scanLine (j);
+			for (int i = x0; i <= x1; i++)
+				out [i] = processed [(i - lens.left()) / step];
+		}
+	}
+}
+
+// Process one horizontal run of lens pixels.  The channel switch is taken once per run, not per pixel.
+void Histo::lensSpan (const QRgb *in, QRgb *out, int count) const
 {
-	QImage newPic (copy.width(), copy.height(), QImage::Format_RGB32);
-	orig = orig.scaled (copy.width(), copy.height());
+	int v;
+	switch (chan)
+	{
+		case Red:
+			for (int i = 0; i < count; i++)
+			{
+				v = qRed (in [i]);
+				out [i] = qRgb (v, v, v);
+			}
+			break;
+		case Green:
+			for (int i = 0; i < count; i++)
+			{
+				v = qGreen (in [i]);
+				out [i] = qRgb (v, v, v);
+			}
+			break;
+		case Blue:
+			for (int i = 0; i < count; i++)
+			{
+				v = qBlue (in [i]);
+				out [i] = qRgb (v, v, v);
+			}
+			break;
+		case Ave:
+			for (int i = 0; i < count; i++)
+			{
+				v = (qRed (in [i]) + qGreen (in [i]) + qBlue (in [i])) / 3;
+				out [i] = qRgb (v, v, v);
+			}
+			break;
+		case Lum:
+			rowKernels().luminance (in, out, count);
+			break;
+		case All:
+			rowKernels().threshold (in, out, count, lut);
+			break;
+		case Ind:
+			for (int i = 0; i < count; i++)
+				out [i] = qRgb (lut [qRed (in [i])], lut [qGreen (in [i])], lut [qBlue (in [i])]);
+			break;
+		case Equalize:
+			for (int i = 0; i < count; i++)
+				out [i] = qRgb (equalized [0][qRed (in [i])], equalized [1][qGreen (in [i])], equalized [2][qBlue (in [i])]);
+			break;
+		default:
+			break;
+	}
+}
 
-	newPic = orig.copy(QRect());
+// Threshold a region of src into the mask planes (one for All, three for Ind) and run the morphology on each.
+void Histo::thresholdRegion (const ImageView &src, const QRect &region)
+{
+	int w = region.width();
+	int h = region.height();
+	int planes = chan == All ? 1 : 3;
+	masks.resize (planes * w * h);
 
-	int result = 0;
-	rad *= rad;
+	Plane mask [3];
+	for (int p = 0; p < planes; p++)
+		mask [p] = Plane (masks.data() + p * w * h, w, w, h);
 
-	for (int j = 0; j < orig.height(); j++)
+	for (int j = 0; j < h; j++)
 	{
-		for (int i = 0; i < orig.width(); i++)
+		const QRgb *in = (const QRgb *)src.scanLine (region.top() + j) + region.left();
+		if (chan == All)
+		{
+			uchar *out = mask [0].scanLine (j);
+			for (int i = 0; i < w; i++)
+				out [i] = lut [luminance (qRed (in [i]), qGreen (in [i]), qBlue (in [i]))];
+		}
+		else
 		{
-			result = (i-x) * (i-x) + (j-y) * (j-y);
-			if (result <= rad)
+			uchar *r = mask [0].scanLine (j);
+			uchar *g = mask [1].scanLine (j);
+			uchar *b = mask [2].scanLine (j);
+			for (int i = 0; i < w; i++)
 			{
-				color = orig.pixel (i, j);
-				switch (chan)
-				{
-					case 0:
-					{
-						colorValue = qRed(color);
-						newPic.setPixel (i, j, qRgb (colorValue, colorValue, colorValue));
-					}
-					break;
-					case 1:
-					{
-						colorValue = qGreen(color);
-						newPic.setPixel (i, j, qRgb (colorValue, colorValue, colorValue));
-					}
-					break;
-					case 2:
-					{
-						colorValue = qBlue(color);
-						newPic.setPixel (i, j, qRgb (colorValue, colorValue, colorValue));
-					}
-					break;
-					case 3:
-					{
-						colorValue = (qRed(color) + qGreen(color) + qBlue(color)) / 3;
-						newPic.setPixel (i, j, qRgb (colorValue, colorValue, colorValue));
-					}
-					break;
-					case 4:
-					{
-						colorValue = 0.3 * qRed(color) + 0.59 * qGreen(color) + 0.11 * qBlue(color);
-						newPic.setPixel (i, j, qRgb (colorValue, colorValue, colorValue));
-					}
-					break;
-					case 5:
-					{
-						colorValue = 0.3 * qRed(color) + 0.59 * qGreen(color) + 0.11 * qBlue(color);
-						colorValue = lut[colorValue];
-						newPic.setPixel (i, j, qRgb (colorValue, colorValue, colorValue));
-					}
-					break;
-					case 6:
-					{
-						newPic.setPixel (i, j, qRgb (lut[qRed(color)], lut[qGreen(color)], lut[qBlue(color)]));
-					}
-				}
+				r [i] = lut [qRed (in [i])];
+				g [i] = lut [qGreen (in [i])];
+				b [i] = lut [qBlue (in [i])];
 			}
 		}
 	}
 
-	return newPic;
+	for (int p = 0; p < planes; p++)
+		morphology.apply (mask [p]);
+}
+
+// Write count filtered mask pixels of image row y, starting at column x, as gray (All) or per band (Ind).
+void Histo::maskSpan (const QRect &region, int y, int x, QRgb *out, int count) const
+{
+	int w = region.width();
+	int plane = w * region.height();
+	const uchar *r = masks.constData() + (y - region.top()) * w + (x - region.left());
+
+	if (chan == All)
+		for (int i = 0; i < count; i++)
+			out [i] = qRgb (r [i], r [i], r [i]);
+	else
+		for (int i = 0; i < count; i++)
+			out [i] = qRgb (r [i], r [plane + i], r [2 * plane + i]);
+}
+
+/*
+	Threshold a whole source (same size as dst) into a mask for region finding, then run the
+		morphology chosen for the threshold views on it.
+	A 16-bit source is compared at full precision: the level, in display levels, becomes the
+		lowest sample the display window shows at that level or above.
+*/
+void Histo::thresholdPlane (const ImageView &src, const Plane &dst, bool individual)
+{
+	if (src.isDeep())
+	{
+		int level = 0;
+		while (level < 256 && !lut [level])
+			level++;
+		int cut = 0;
+		while (cut < 65536 && src.window [cut] < level)
+			cut++;
+		thresholdDeep (src, dst, cut, individual);
+	}
+	else
+	{
+		ThresholdRows threshold (dst, lut, individual);
+		dispatchPixels (src, threshold);
+	}
+	morphology.apply (dst);
+}
+
+// Choose the morphology applied to the threshold views of the lens.
+void Histo::setMorphology (Morphology::Operation op, Morphology::Element element, int size)
+{
+	morphology.setOperation (op);
+	morphology.setElement (element, size);
+}
+
+// Show a color-space channel (Hue and after) instead of the one picked by setState.
+void Histo::setChannel (Channel channel)
+{
+	chan = channel;
+}
+
+/*
+	The 8-bit plane of a color-space channel for the 32-bit frame src.  It is cached until the
+		next scaleImage() (or releasePlanes()), so lens moves and repaints only read it.
+*/
+Plane Histo::channelPlane (Channel channel, const ImageView &src)
+{
+	return colorPlanes.plane (ColorPlanes::Channel (channel - Hue), src);
+}
+
+// Tile grid and clip limit of the CLAHE view; the cached result is computed again.
+void Histo::setClahe (int columns, int rows, double clip)
+{
+	clahe.setTiles (columns, rows);
+	clahe.setClipLimit (clip);
+	claheValid = false;
+}
+
+/*
+	CLAHE of the luminance of the 32-bit frame src, cached until the next scaleImage(),
+		setClahe() or releasePlanes().
+*/
+Plane Histo::clahePlane (const ImageView &src)
+{
+	int size = src.width * src.height;
+	if (!claheValid || claheOut.size() != size)
+	{
+		claheGray.resize (size);
+		claheOut.resize (size);
+		Plane gray (claheGray.data(), src.width, src.width, src.height);
+		grayPlane (src, gray);
+		clahe.apply (gray, Plane (claheOut.data(), src.width, src.width, src.height));
+		claheValid = true;
+	}
+	return Plane (claheOut.data(), src.width, src.width, src.height);
+}
+
+// Global histogram equalization of every band of the 32-bit src into dst, using the statistics of the whole image.
+void Histo::equalizeImage (const ImageView &src, QImage &dst)
+{
+	int w = qMin (src.width, dst.width());
+	for (int y = 0; y < qMin (src.height, dst.height()); y++)
+	{
+		const QRgb *in = (const QRgb *)src.scanLine (y);
+		QRgb *out = (QRgb *)dst.scanLine (y);
+		for (int x = 0; x < w; x++)
+			out [x] = qRgb (equalized [0][qRed (in [x])], equalized [1][qGreen (in [x])], equalized [2][qBlue (in [x])]);
+	}
 }
 
 // Set the appropriate state so the Magic Glass function can decide which channel to process.
@@ -226,135 +1213,278 @@ void Histo::setState (bool r, bool g, bool b, bool ags, bool lgs, bool all, bool
 		chan = Ind;
 }
 
+/*
+	Nearest-neighbour scaling of src, in any format pixelaccess.h reads, into the 32-bit dst
+		(the size of dst decides the target size).
+*/
+void Histo::scaleImage (const ImageView &src, QImage &dst)
+{
+	if (src.isNull() || dst.isNull())
+		return;
+
+	colorPlanes.invalidate();
+	claheValid = false;
+	ScaleRows scale (dst);
+	dispatchPixels (src, scale);
+}
+
+// Luminance gray plane of a source in any format pixelaccess.h reads.  Sizes of src and dst must match.
+void Histo::grayPlane (const ImageView &src, const Plane &dst)
+{
+	if (src.layout == ImageView::Rgb32)
+	{
+		const RowKernels &kernels = rowKernels();
+		for (int y = 0; y < dst.height; y++)
+			kernels.gray ((const QRgb *)src.scanLine (y), dst.scanLine (y), dst.width);
+		return;
+	}
+
+	GrayRows gray (dst);
+	dispatchPixels (src, gray);
+}
+
+// Expand a gray plane into a 32-bit gray image.
+void Histo::grayToImage (const Plane &gray, QImage &dst)
+{
+	for (int y = 0; y < gray.height; y++)
+	{
+		const uchar *in = gray.scanLine (y);
+		QRgb *out = (QRgb *)dst.scanLine (y);
+		for (int x = 0; x < gray.width; x++)
+			out [x] = qRgb (in [x], in [x], in [x]);
+	}
+}
+
 // Prewitt edge detection implementation using Prewitt equations.
 // First turn the image into gray image and then perform detection.
-QImage Histo::prewittMask (QImage orig, QImage copy)
+QImage Histo::prewittMask (const QImage &orig, const QImage &copy)
 {
-	QImage newPic (copy.width(), copy.height(), QImage::Format_RGB32);
-	orig = orig.scaled (copy.width(), copy.height());
-
-	orig = grayIm (orig);
+	QImage src (copy.size(), QImage::Format_RGB32);
+	scaleImage (ImageView (readable (orig)), src);
+	QVector<uchar> buffer (src.width() * src.height());
+	Plane gray (buffer.data(), src.width(), src.width(), src.height());
+	grayPlane (ImageView (src), gray);
 
-	int gx, gy, grad;
+	QImage newPic (src.size(), QImage::Format_RGB32);
+	prewittMask (gray, newPic);
+	return newPic;
+}
 
-	gx = gy = grad = 0;
+// Prewitt kernel on a gray plane.  Border pixels are set to zero; rows go through rowKernels().
+void Histo::prewittMask (const Plane &gray, QImage &dst)
+{
+	int w = gray.width;
+	int h = gray.height;
+	const RowKernels &kernels = rowKernels();
 
-	for (int y = 0; y < orig.height(); y++)
+	for (int y = 0; y < h; y++)
 	{
-		for (int x = 0; x < orig.width(); x++)
+		QRgb *out = (QRgb *)dst.scanLine (y);
+		if (y == 0 || y == h - 1)
 		{
-			if (x == 0 || x == (orig.width() - 1))
-				grad = 0;
-			else if (y == 0 || y == (orig.height() - 1))
-				grad = 0;
-			else
-			{
-				gx = (qBlue(orig.pixel(x-1,y+1)) + qBlue(orig.pixel(x,y+1)) + qBlue(orig.pixel(x+1,y+1))) - (qBlue(orig.pixel(x-1,y-1)) + qBlue(orig.pixel(x,y-1)) + qBlue(orig.pixel(x+1,y-1)));
-				gy = (qBlue(orig.pixel(x+1,y-1)) + qBlue(orig.pixel(x+1,y)) + qBlue(orig.pixel(x+1,y+1))) - (qBlue(orig.pixel(x-1,y-1)) + qBlue(orig.pixel(x-1,y)) + qBlue(orig.pixel(x-1,y+1)));
+			for (int x = 0; x < w; x++)
+				out [x] = qRgb (0, 0, 0);
+			continue;
+		}
 
-				if (gx < 0)
-					gx = -gx;
-				else if (gy < 0)
-					gy = -gy;
+		const uchar *p = gray.scanLine (y - 1);
+		const uchar *c = gray.scanLine (y);
+		const uchar *n = gray.scanLine (y + 1);
 
-				grad = gx + gy;
-			}
-			newPic.setPixel (x, y, qRgb (grad, grad, grad));
-		}
+		out [0] = out [w - 1] = qRgb (0, 0, 0);
+		kernels.prewitt (p, c, n, out, w);
 	}
-
-	return newPic;
 }
 
 // Sobel edge detection implementation using Sobel equations.
 // First turn the image into gray image and then perform detection.
-QImage Histo::sobelMask (QImage orig, QImage copy)
+QImage Histo::sobelMask (const QImage &orig, const QImage &copy)
 {
-	QImage newPic (copy.width(), copy.height(), QImage::Format_RGB32);
-	orig = orig.scaled (copy.width(), copy.height());
+	QImage src (copy.size(), QImage::Format_RGB32);
+	scaleImage (ImageView (readable (orig)), src);
+	QVector<uchar> buffer (src.width() * src.height());
+	Plane gray (buffer.data(), src.width(), src.width(), src.height());
+	grayPlane (ImageView (src), gray);
 
-	orig = grayIm (orig);
-
-	int gx, gy, grad;
+	QImage newPic (src.size(), QImage::Format_RGB32);
+	sobelMask (gray, newPic);
+	return newPic;
+}
 
-	gx = gy = grad = 0;
+// Sobel kernel on a gray plane.  Border pixels are set to zero; rows go through rowKernels().
+void Histo::sobelMask (const Plane &gray, QImage &dst)
+{
+	int w = gray.width;
+	int h = gray.height;
+	const RowKernels &kernels = rowKernels();
 
-	for (int y = 0; y < orig.height(); y++)
+	for (int y = 0; y < h; y++)
 	{
-		for (int x = 0; x < orig.width(); x++)
+		QRgb *out = (QRgb *)dst.scanLine (y);
+		if (y == 0 || y == h - 1)
 		{
-			if (x == 0 || x == (orig.width() - 1))
-				grad = 0;
-			else if (y == 0 || y == (orig.height() - 1))
-				grad = 0;
-			else
-			{
-				gx = (qBlue(orig.pixel(x-1,y+1)) + 2*qBlue(orig.pixel(x,y+1)) + qBlue(orig.pixel(x+1,y+1))) - (qBlue(orig.pixel(x-1,y-1)) + 2*qBlue(orig.pixel(x,y-1)) + qBlue(orig.pixel(x+1,y-1)));
-				gy = (qBlue(orig.pixel(x+1,y-1)) + 2*qBlue(orig.pixel(x+1,y)) + qBlue(orig.pixel(x+1,y+1))) - (qBlue(orig.pixel(x-1,y-1)) + 2*qBlue(orig.pixel(x-1,y)) + qBlue(orig.pixel(x-1,y+1)));
+			for (int x = 0; x < w; x++)
+				out [x] = qRgb (0, 0, 0);
+			continue;
+		}
 
-				if (gx < 0)
-					gx = -gx;
-				else if (gy < 0)
-					gy = -gy;
+		const uchar *p = gray.scanLine (y - 1);
+		const uchar *c = gray.scanLine (y);
+		const uchar *n = gray.scanLine (y + 1);
 
-				grad = gx + gy;
-			}
-			newPic.setPixel (x, y, qRgb (grad, grad, grad));
-		}
+		out [0] = out [w - 1] = qRgb (0, 0, 0);
+		kernels.sobel (p, c, n, out, w);
 	}
-
-	return newPic;
 }
 
 // LoG edge detection implementation.
 // First turn the image into gray image and then perform detection.
-QImage Histo::LoGMask (QImage orig, QImage copy)
+QImage Histo::LoGMask (const QImage &orig, const QImage &copy)
 {
-	QImage newPic (copy.width(), copy.height(), QImage::Format_RGB32);
-	orig = orig.scaled (copy.width(), copy.height());
+	QImage src (copy.size(), QImage::Format_RGB32);
+	scaleImage (ImageView (readable (orig)), src);
+	QVector<uchar> buffer (src.width() * src.height());
+	Plane gray (buffer.data(), src.width(), src.width(), src.height());
+	grayPlane (ImageView (src), gray);
 
-	orig = grayIm (orig);
+	QImage newPic (src.size(), QImage::Format_RGB32);
+	LoGMask (gray, newPic);
+	return newPic;
+}
 
-	int log = 0;
+// 5x5 LoG kernel on a gray plane.  The two outermost rows and columns are set to zero.
+void Histo::LoGMask (const Plane &gray, QImage &dst)
+{
+	int w = gray.width;
+	int h = gray.height;
+	const RowKernels &kernels = rowKernels();
 
-	for (int y = 0; y < orig.height(); y++)
+	for (int y = 0; y < h; y++)
 	{
-		for (int x = 0; x < orig.width(); x++)
+		QRgb *out = (QRgb *)dst.scanLine (y);
+		if (y < 2 || y > h - 3)
 		{
-			if (x == 0 || x== 1 || x == (orig.width() - 1) || x == (orig.width() - 2))
-				log = 0;
-			else if (y == 0 || y == 1 || y == (orig.height() - 1) || y == (orig.height() - 2))
-				log = 0;
-			else
+			for (int x = 0; x < w; x++)
+				out [x] = qRgb (0, 0, 0);
+			continue;
+		}
+
+		const uchar *pp = gray.scanLine (y - 2);
+		const uchar *p = gray.scanLine (y - 1);
+		const uchar *c = gray.scanLine (y);
+		const uchar *n = gray.scanLine (y + 1);
+		const uchar *nn = gray.scanLine (y + 2);
+
+		for (int x = 0; x < qMin (2, w); x++)
+			out [x] = out [w - 1 - x] = qRgb (0, 0, 0);
+		kernels.LoG (pp, p, c, n, nn, out, w);
+	}
+}
+
+/*
+	Luminance of a 16-bit source at full precision, scaled (nearest neighbour, 16.16 fixed-point
+		steps as in ScaleRows) to the size of dst, for the 16-bit edge kernels.
+*/
+void Histo::deepGrayPlane (const ImageView &src, const Plane16 &dst)
+{
+	qint64 stepX = ((qint64)src.width << 16) / dst.width;
+	qint64 stepY = ((qint64)src.height << 16) / dst.height;
+
+	qint64 fy = 0;
+	for (int y = 0; y < dst.height; y++, fy += stepY)
+	{
+		const quint16 *in = (const quint16 *)src.scanLine ((int)(fy >> 16));
+		quint16 *out = dst.scanLine (y);
+		qint64 fx = 0;
+		if (src.layout == ImageView::Gray16)
+			for (int x = 0; x < dst.width; x++, fx += stepX)
+				out [x] = in [fx >> 16];
+		else
+			for (int x = 0; x < dst.width; x++, fx += stepX)
 			{
-				log = 16*qBlue(orig.pixel(x,y)) - (qBlue(orig.pixel(x,y-2))+qBlue(orig.pixel(x-1,y-1))+2*qBlue(orig.pixel(x,y-1))+qBlue(orig.pixel(x+1,y-1))+qBlue(orig.pixel(x-2,y))+2*qBlue(orig.pixel(x-1,y))+2*qBlue(orig.pixel(x+1,y))+qBlue(orig.pixel(x+2,y))+qBlue(orig.pixel(x-1,y+1))+2*qBlue(orig.pixel(x,y+1))+qBlue(orig.pixel(x+1,y+1))+qBlue(orig.pixel(x,y+2)));
-				if (log > 255)
-					log = 255;
-				else if (log < 0)
-					log = 0;
+				const quint16 *p = in + 3 * (fx >> 16);
+				out [x] = luminance (p [0], p [1], p [2]);
 			}
-			newPic.setPixel (x, y, qRgb (log, log, log));
+	}
+}
+
+// Prewitt kernel on a 16-bit plane, with 32-bit sums.  Borders as in the 8-bit prewittMask().
+void Histo::prewittMask (const Plane16 &gray, QImage &dst, float gain)
+{
+	int w = gray.width;
+	int h = gray.height;
+	const RowKernels &kernels = rowKernels();
+
+	for (int y = 0; y < h; y++)
+	{
+		QRgb *out = (QRgb *)dst.scanLine (y);
+		if (y == 0 || y == h - 1)
+		{
+			for (int x = 0; x < w; x++)
+				out [x] = qRgb (0, 0, 0);
+			continue;
 		}
+
+		out [0] = out [w - 1] = qRgb (0, 0, 0);
+		kernels.prewitt16 (gray.scanLine (y - 1), gray.scanLine (y), gray.scanLine (y + 1), out, w, gain);
 	}
+}
 
-	return newPic;
+// Sobel kernel on a 16-bit plane, with 32-bit sums.
+void Histo::sobelMask (const Plane16 &gray, QImage &dst, float gain)
+{
+	int w = gray.width;
+	int h = gray.height;
+	const RowKernels &kernels = rowKernels();
+
+	for (int y = 0; y < h; y++)
+	{
+		QRgb *out = (QRgb *)dst.scanLine (y);
+		if (y == 0 || y == h - 1)
+		{
+			for (int x = 0; x < w; x++)
+				out [x] = qRgb (0, 0, 0);
+			continue;
+		}
+
+		out [0] = out [w - 1] = qRgb (0, 0, 0);
+		kernels.sobel16 (gray.scanLine (y - 1), gray.scanLine (y), gray.scanLine (y + 1), out, w, gain);
+	}
 }
 
-// Luminance gray scale function.  Implemented for edge detection.
-QImage Histo::grayIm (QImage im)
+// 5x5 LoG kernel on a 16-bit plane, with 32-bit sums.
+void Histo::LoGMask (const Plane16 &gray, QImage &dst, float gain)
 {
-	QImage newPic (im.width(), im.height(), QImage::Format_RGB32);
+	int w = gray.width;
+	int h = gray.height;
+	const RowKernels &kernels = rowKernels();
 
-	for (int y = 0; y < im.height(); y++)
+	for (int y = 0; y < h; y++)
 	{
-		for (int x = 0; x < im.width(); x++)
+		QRgb *out = (QRgb *)dst.scanLine (y);
+		if (y < 2 || y > h - 3)
 		{
-			color = im.pixel (x, y);
-			colorValue = 0.3 * qRed(color) + 0.59 * qGreen(color) + 0.11 * qBlue(color);
-			newPic.setPixel (x, y, qRgb (colorValue, colorValue, colorValue));
+			for (int x = 0; x < w; x++)
+				out [x] = qRgb (0, 0, 0);
+			continue;
 		}
+
+		for (int x = 0; x < qMin (2, w); x++)
+			out [x] = out [w - 1 - x] = qRgb (0, 0, 0);
+		kernels.LoG16 (gray.scanLine (y - 2), gray.scanLine (y - 1), gray.scanLine (y), gray.scanLine (y + 1), gray.scanLine (y + 2), out, w, gain);
 	}
+}
+
+// Luminance gray scale function.  Implemented for edge detection.
+QImage Histo::grayIm (const QImage &im)
+{
+	QImage src = readable (im);
+	QVector<uchar> buffer (src.width() * src.height());
+	Plane gray (buffer.data(), src.width(), src.width(), src.height());
+	grayPlane (ImageView (src), gray);
 
+	QImage newPic (src.size(), QImage::Format_RGB32);
+	grayToImage (gray, newPic);
 	return newPic;
 }
-//Wai Khoo
\ No newline at end of file
+//Wai Khoo
@@ -8,39 +8,143 @@
 #define HISTO_H
 
 #include <QtGui>
+#include "imageview.h"
+#include "colortable.h"
+#include "morphology.h"
+#include "colorspace.h"
+#include "clahe.h"
+#include "magnifier.h"
+
+/*
+	Per-channel and joint color counts of one image, computed off the GUI thread.
+	An estimate counts a sample of samples out of the image's pixels and has no joint counts.
+	A 16-bit source is counted into deep instead: 65536 bins for gray, three times that (red,
+		green, blue) for color.  The 256-level counts and the joint counts are then unused.
+*/
+struct HistoStatistics
+{
+	int red [256];
+	int green [256];
+	int blue [256];
+	ColorTable colors;
+	QVector<int> deep;
+	qint64 pixels;
+	qint64 samples;
+	bool cancelled;
+};
 
 class Histo : public QWidget
 {
 	Q_OBJECT
 
 public:
-	enum Channel {Red, Green, Blue, Ave, Lum, All, Ind};
+	enum Channel {Red, Green, Blue, Ave, Lum, All, Ind, Hue, Saturation, Chroma, Cb, Cr, LStar, AStar, BStar, Equalize, Adaptive};
 	Histo(QWidget *parent = 0, Qt::WFlags f = 0);
-	void histoCalc(QImage image);
+	~Histo();
+	void histoCalc(const QImage &image);
+	void startCalc (const QImage &image);
+	void startCalc (const ImageView &source);
+	void setWindow (const ImageView &source);
+	void cancelCalc();
+	void waitForCalc();
+	bool isReady() const;
+	QVector<int> counts (Channel channel) const;
+	static HistoStatistics statistics (QImage image, QSharedPointer<QAtomicInt> cancel);
+	static HistoStatistics viewStatistics (ImageView source, QSharedPointer<QAtomicInt> cancel);
+	static HistoStatistics estimate (const QImage &image);
+	static HistoStatistics estimate (const ImageView &source);
+	static HistoStatistics deepStatistics (ImageView source, QSharedPointer<QAtomicInt> cancel);
+	bool isEstimate() const;
 	void drawHisto(const QString &fileName);
 	QImage thresholdLevel (QImage originalPic, QImage copyPic, int thresLevel, bool all, bool individual);
 	void lookUpTable (int thresLevel);
-	QImage magicGlass (QImage orig, QImage copy, int rad, int x, int y);
+	QImage magicGlass (const QImage &orig, const QImage &copy, int rad, int x, int y);
 	void setState (bool r, bool g, bool b, bool ags, bool lgs, bool all, bool individual, int value);
-	QImage prewittMask (QImage orig, QImage copy);
-	QImage sobelMask (QImage orig, QImage copy);
-	QImage LoGMask (QImage orig, QImage copy);
-	QImage grayIm (QImage im);
+	void setChannel (Channel channel);
+	void setClahe (int columns, int rows, double clip);
+	void setMorphology (Morphology::Operation op, Morphology::Element element, int size);
+	void thresholdPlane (const ImageView &src, const Plane &dst, bool individual);
+	QImage prewittMask (const QImage &orig, const QImage &copy);
+	QImage sobelMask (const QImage &orig, const QImage &copy);
+	QImage LoGMask (const QImage &orig, const QImage &copy);
+	QImage grayIm (const QImage &im);
+	qint64 statisticsBytes() const;
+	qint64 cacheBytes() const;
+	void releasePlanes();
+
+	// Allocation-free kernels.  Sources are views in any layout ImageView supports (or planes), destinations are caller-provided.
+	void scaleImage (const ImageView &src, QImage &dst);
+	void grayPlane (const ImageView &src, const Plane &dst);
+	void grayToImage (const Plane &gray, QImage &dst);
+	Plane channelPlane (Channel channel, const ImageView &src);
+	Plane clahePlane (const ImageView &src);
+	void equalizeImage (const ImageView &src, QImage &dst);
+	QRect magicGlass (const ImageView &src, QImage &dst, const QRect &previous, int rad, int x, int y, int step = 1);
+	QRect magnifiedGlass (const ImageView &source, const ImageView &src, QImage &dst, const QRect &previous, int rad, int x, int y, double magnification);
+	void setInterpolation (Magnifier::Interpolation interpolation);
+	void prewittMask (const Plane &gray, QImage &dst);
+	void sobelMask (const Plane &gray, QImage &dst);
+	void LoGMask (const Plane &gray, QImage &dst);
+
+	// Full-precision kernels for 16-bit sources.  gain takes a 16-bit response to display levels.
+	void deepGrayPlane (const ImageView &src, const Plane16 &dst);
+	void prewittMask (const Plane16 &gray, QImage &dst, float gain);
+	void sobelMask (const Plane16 &gray, QImage &dst, float gain);
+	void LoGMask (const Plane16 &gray, QImage &dst, float gain);
 
 signals:
 	void histoValue (int r, int g, int b);
+	void histoEstimate (int r, int g, int b, int rMargin, int gMargin, int bMargin);
+	void colorFrequency (int count);
+	void histoPending();
+	void statisticsReady();
 
 public slots:
 	void showHisto(int r, int g, int b);
 
+private slots:
+	void calcFinished();
+
 private:
+	void install (const HistoStatistics &stats);
+	int margin (int band, int level) const;
+	void equalizeTables();
+	void binDeep();
+	void lensSpan (const QRgb *in, QRgb *out, int count) const;
+	void coarseLens (const ImageView &src, QImage &dst, const Plane &space, const QRect &lens, int rad2, int x, int y, int step);
+	void thresholdRegion (const ImageView &src, const QRect &region);
+	void maskSpan (const QRect &region, int y, int x, QRgb *out, int count) const;
 
 	Channel chan;
 
 	int *redHisto;
 	int *greenHisto;
 	int *blueHisto;
-	int *lut;
+	ColorTable colors;
+	QVector<int> deepCounts;	// 65536-bin counts of a 16-bit source (see HistoStatistics); the histograms above are their binned view
+	QVector<uchar> displayLevels;	// display window of that source, which the binned view sums by
+	QFutureWatcher<HistoStatistics> *watcher;
+	QSharedPointer<QAtomicInt> cancel;
+	bool ready;
+	bool approximate;			// the histograms are scaled up from a sample (see estimate())
+	int sampled [3][256];		// sample counts of the red, green and blue estimate, for its confidence intervals
+	qint64 samples;
+	qint64 pixels;
+	uchar lut [256];
+	Morphology morphology;
+	QVector<uchar> masks;		// thresholded lens region, one plane per band, for morphology
+	QVector<QRgb> spans;		// sampled and processed lens row of the coarse lens
+	ColorPlanes colorPlanes;	// color-space channels of the scaled frame
+	uchar equalized [3][256];	// global equalization of the red, green and blue histograms
+	Clahe clahe;
+	QVector<uchar> claheGray;	// luminance of the scaled frame, and its CLAHE, cached like colorPlanes
+	QVector<uchar> claheOut;
+	bool claheValid;
+	Magnifier magnifier;
+	QVector<int> lensRows;		// spans of the magnified lens area to resample (see Magnifier::resample)
+	ColorPlanes lensPlanes;		// color-space channels and CLAHE of the magnified lens area, redone every frame
+	QVector<uchar> lensGray;
+	QVector<uchar> lensClahe;
 	int colorValue;
 	int max;
 	int maxRed;
@@ -62,5 +166,11 @@ private:
 
 	QRgb color;
 };
+
+// Integer form of the 0.3 / 0.59 / 0.11 luminance weights used throughout Histo.
+inline int luminance (int r, int g, int b)
+{
+	return (77 * r + 151 * g + 28 * b) >> 8;
+}
 #endif
 //Wai Khoo
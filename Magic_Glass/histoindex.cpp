@@ -0,0 +1,345 @@
+/*
+	The implementation of histoindex.h.
+*/
+#include <QtGui>
+#include <algorithm>
+#include "histoindex.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static const quint32 IndexMagic = 0x4d474849;	// "MGHI"
+static const quint32 IndexVersion = 1;
+static const int FilesPerBatch = 1024;			// bounds the features held in memory while building
+static const int DecodeLimit = 1024;			// images are decoded at most this large on their long side
+
+// Swap the two bytes of every sample, between the file's little-endian columns and a big-endian machine's.
+static void swapBytes (QVector<quint16> &samples)
+{
+	quint16 *s = samples.data();
+	for (int i = 0; i < samples.size(); i++)
+		s [i] = (quint16)(s [i] << 8 | s [i] >> 8);
+}
+
+HistoIndex::HistoIndex()
+{
+	joint = false;
+}
+
+int HistoIndex::size() const
+{
+	return names.size();
+}
+
+bool HistoIndex::hasJoint() const
+{
+	return joint;
+}
+
+int HistoIndex::bins (Column column)
+{
+	return column == JointColumn ? JointBins : ChannelBins;
+}
+
+/*
+	Compute the histograms of every readable image in a directory.
+	Images are decoded and counted in parallel (QtConcurrent), a batch of files at a time so the
+		memory used for the features stays bounded however large the library is.
+*/
+bool HistoIndex::build (const QString &directory, bool withJoint)
+{
+	QStringList filters;
+	QList<QByteArray> formats = QImageReader::supportedImageFormats();
+	for (int i = 0; i < formats.size(); i++)
+		filters << "*." + QString (formats [i]);
+
+	QDir dir (directory);
+	if (!dir.exists())
+		return false;
+	QStringList files = dir.entryList (filters, QDir::Files, QDir::Name);
+
+	joint = withJoint;
+	names.clear();
+	for (int c = 0; c < ColumnCount; c++)
+		columns [c].clear();
+
+	for (int first = 0; first < files.size(); first += FilesPerBatch)
+	{
+		QStringList batch;
+		for (int i = first; i < files.size() && i < first + FilesPerBatch; i++)
+			batch << dir.absoluteFilePath (files [i]);
+
+		QList<Features> features = joint ? QtConcurrent::blockingMapped (batch, &HistoIndex::extractJoint)
+										 : QtConcurrent::blockingMapped (batch, &HistoIndex::extractChannels);
+
+		for (int i = 0; i < features.size(); i++)
+		{
+			if (!features [i].valid)
+				continue;
+			names << features [i].fileName;
+			for (int c = 0; c < ColumnCount; c++)
+				columns [c] += features [i].column [c];
+		}
+	}
+	return true;
+}
+
+HistoIndex::Features HistoIndex::extractChannels (const QString &fileName)
+{
+	return extract (fileName, false);
+}
+
+HistoIndex::Features HistoIndex::extractJoint (const QString &fileName)
+{
+	return extract (fileName, true);
+}
+
+/*
+	Decode one image (reduced size for large files; a histogram does not need every pixel) and
+		return its normalized histograms.  Runs on worker threads, so it must not touch any widget.
+*/
+HistoIndex::Features HistoIndex::extract (const QString &fileName, bool withJoint)
+{
+	Features f;
+	f.fileName = fileName;
+
+	QImageReader reader (fileName);
+	QSize size = reader.size();
+	if (size.isValid() && qMax (size.width(), size.height()) > DecodeLimit)
+	{
+		size.scale (DecodeLimit, DecodeLimit, Qt::KeepAspectRatio);
+		reader.setScaledSize (size);
+	}
+
+	f.valid = histograms (reader.read(), withJoint, f.column);
+	return f;
+}
+
+// Count the histograms of an image and scale every column so the whole image is 65535.
+bool HistoIndex::histograms (const QImage &source, bool withJoint, QVector<quint16> *column)
+{
+	if (source.isNull())
+		return false;
+	QImage image = source.convertToFormat (QImage::Format_RGB32);
+
+	QVector<int> counts [ColumnCount];
+	for (int c = 0; c < ColumnCount; c++)
+		counts [c].fill (0, bins (Column (c)));
+	int *r = counts [RedColumn].data();
+	int *g = counts [GreenColumn].data();
+	int *b = counts [BlueColumn].data();
+	int *rgb = counts [JointColumn].data();
+
+	for (int y = 0; y < image.height(); y++)
+	{
+		const QRgb *line = (const QRgb *)image.scanLine (y);
+		for (int x = 0; x < image.width(); x++)
+		{
+			QRgb color = line [x];
+			r [qRed (color)]++;
+			g [qGreen (color)]++;
+			b [qBlue (color)]++;
+			if (withJoint)
+				rgb [((qRed (color) >> 5) << 6) | ((qGreen (color) >> 5) << 3) | (qBlue (color) >> 5)]++;
+		}
+	}
+
+	double total = (double)image.width() * image.height();
+	for (int c = 0; c < ColumnCount; c++)
+	{
+		if (c == JointColumn && !withJoint)
+			continue;
+		column [c].resize (counts [c].size());
+		for (int i = 0; i < counts [c].size(); i++)
+			column [c][i] = (quint16)qRound (counts [c][i] * 65535.0 / total);
+	}
+	return true;
+}
+
+/*
+	File layout (little-endian):
+		magic, version, image count, joint flag		4 x quint32
+		file names									count x (quint32 length + UTF-8 bytes)
+		red, green, blue [, joint] columns			count x bins x quint16 each
+	The columns are written and read as raw memory; a big-endian machine swaps them on the way.
+*/
+bool HistoIndex::save (const QString &fileName) const
+{
+	QFile file (fileName);
+	if (!file.open (QIODevice::WriteOnly))
+		return false;
+
+	QDataStream out (&file);
+	out.setByteOrder (QDataStream::LittleEndian);
+	out << IndexMagic << IndexVersion << (quint32)names.size() << (quint32)(joint ? 1 : 0);
+
+	for (int i = 0; i < names.size(); i++)
+		out << names [i].toUtf8();
+
+	for (int c = 0; c < ColumnCount; c++)
+	{
+		if (c == JointColumn && !joint)
+			continue;
+		QVector<quint16> column = columns [c];
+		if (QSysInfo::ByteOrder == QSysInfo::BigEndian)
+			swapBytes (column);
+		out.writeRawData ((const char *)column.constData(), column.size() * sizeof (quint16));
+	}
+	return out.status() == QDataStream::Ok;
+}
+
+// Read an index written by save().  The columns are read straight into memory, no per-entry parsing.
+bool HistoIndex::load (const QString &fileName)
+{
+	QFile file (fileName);
+	if (!file.open (QIODevice::ReadOnly))
+		return false;
+
+	QDataStream in (&file);
+	in.setByteOrder (QDataStream::LittleEndian);
+	quint32 magic, version, count, flags;
+	in >> magic >> version >> count >> flags;
+	if (magic != IndexMagic || version != IndexVersion)
+		return false;
+
+	joint = flags & 1;
+	names.clear();
+	for (quint32 i = 0; i < count; i++)
+	{
+		QByteArray name;
+		in >> name;
+		names << QString::fromUtf8 (name.constData(), name.size());
+	}
+
+	for (int c = 0; c < ColumnCount; c++)
+	{
+		columns [c].clear();
+		if (c == JointColumn && !joint)
+			continue;
+		columns [c].resize (count * bins (Column (c)));
+		int bytes = columns [c].size() * sizeof (quint16);
+		if (in.readRawData ((char *)columns [c].data(), bytes) != bytes)
+			return false;
+		if (QSysInfo::ByteOrder == QSysInfo::BigEndian)
+			swapBytes (columns [c]);
+	}
+	return in.status() == QDataStream::Ok;
+}
+
+/*
+	Rank every indexed image against a query image (smallest distance first) and return the best count.
+	The distance of an entry is the sum of the distances of its columns.
+*/
+QList<HistoIndex::Match> HistoIndex::query (const QImage &image, Metric metric, int count) const
+{
+	QList<Match> matches;
+	QVector<quint16> q [ColumnCount];
+	if (!histograms (image, joint, q))
+		return matches;
+
+	QVector<float> qf [ColumnCount];
+	for (int c = 0; c < ColumnCount; c++)
+	{
+		qf [c].resize (q [c].size());
+		for (int i = 0; i < q [c].size(); i++)
+			qf [c][i] = q [c][i];
+	}
+
+	QVector<QPair<float, int> > ranked (names.size());
+	for (int e = 0; e < names.size(); e++)
+	{
+		float d = 0;
+		for (int c = 0; c < ColumnCount; c++)
+		{
+			if (qf [c].isEmpty())
+				continue;
+			int n = bins (Column (c));
+			d += distance (metric, qf [c].constData(), columns [c].constData() + e * n, n);
+		}
+		ranked [e] = qMakePair (d, e);
+	}
+
+	count = qBound (0, count, ranked.size());
+	std::partial_sort (ranked.begin(), ranked.begin() + count, ranked.end());
+	for (int i = 0; i < count; i++)
+	{
+		Match m;
+		m.fileName = names [ranked [i].second];
+		m.distance = ranked [i].first;
+		matches << m;
+	}
+	return matches;
+}
+
+/*
+	Distance between a query histogram and one stored entry, both scaled so a whole image is 65535.
+	The SSE2 path converts eight stored bins at a time to float and scores them four lanes at a time.
+	n is always a multiple of 8 (256 or 512 bins).  The result is normalized to about [0, 2].
+*/
+float HistoIndex::distance (Metric metric, const float *query, const quint16 *entry, int n)
+{
+	float sum = 0;
+	int i = 0;
+
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 sign = _mm_set1_ps (-0.0f);
+	const __m128 tiny = _mm_set1_ps (1e-6f);
+	__m128 acc = _mm_setzero_ps();
+
+	for (; i + 8 <= n; i += 8)
+	{
+		__m128i e16 = _mm_loadu_si128 ((const __m128i *)(entry + i));
+		__m128 e [2] = {_mm_cvtepi32_ps (_mm_unpacklo_epi16 (e16, zero)), _mm_cvtepi32_ps (_mm_unpackhi_epi16 (e16, zero))};
+		for (int k = 0; k < 2; k++)
+		{
+			__m128 a = _mm_loadu_ps (query + i + 4 * k);
+			__m128 d = _mm_sub_ps (a, e [k]);
+			switch (metric)
+			{
+				case L1:
+					acc = _mm_add_ps (acc, _mm_andnot_ps (sign, d));
+					break;
+				case ChiSquare:
+				{
+					__m128 s = _mm_add_ps (a, e [k]);
+					__m128 term = _mm_div_ps (_mm_mul_ps (d, d), _mm_max_ps (s, tiny));
+					acc = _mm_add_ps (acc, _mm_and_ps (_mm_cmpgt_ps (s, _mm_setzero_ps()), term));
+				}
+				break;
+				case Intersection:
+					acc = _mm_add_ps (acc, _mm_min_ps (a, e [k]));
+					break;
+			}
+		}
+	}
+
+	float lanes [4];
+	_mm_storeu_ps (lanes, acc);
+	sum = lanes [0] + lanes [1] + lanes [2] + lanes [3];
+#endif
+
+	for (; i < n; i++)
+	{
+		float a = query [i];
+		float b = entry [i];
+		switch (metric)
+		{
+			case L1:
+				sum += qAbs (a - b);
+				break;
+			case ChiSquare:
+				if (a + b > 0)
+					sum += (a - b) * (a - b) / (a + b);
+				break;
+			case Intersection:
+				sum += qMin (a, b);
+				break;
+		}
+	}
+
+	if (metric == Intersection)
+		return 1.0f - sum / 65535.0f;
+	return sum / 65535.0f;
+}
@@ -0,0 +1,54 @@
+/*
+	Batch histogram extraction and a similarity index over an image library.
+	build() computes per-channel (and optionally joint quantized RGB) histograms for every image in a
+		directory in parallel and stores them in a compact columnar file: a column of file names,
+		then one column per histogram block, each holding the block for every image back to back.
+	query() loads the columns and ranks every image against a query image by histogram distance.
+*/
+#ifndef HISTOINDEX_H
+#define HISTOINDEX_H
+
+#include <QtGui>
+
+class HistoIndex
+{
+public:
+	enum Metric {L1, ChiSquare, Intersection};
+	enum Column {RedColumn, GreenColumn, BlueColumn, JointColumn, ColumnCount};
+	enum {ChannelBins = 256, JointBins = 512};	// joint histogram uses 3 bits per channel
+
+	struct Match
+	{
+		QString fileName;
+		float distance;
+	};
+
+	HistoIndex();
+	bool build (const QString &directory, bool joint);
+	bool save (const QString &fileName) const;
+	bool load (const QString &fileName);
+	QList<Match> query (const QImage &image, Metric metric, int count) const;
+	int size() const;
+	bool hasJoint() const;
+
+	static int bins (Column column);
+
+private:
+	struct Features
+	{
+		QString fileName;
+		bool valid;
+		QVector<quint16> column [ColumnCount];
+	};
+
+	static Features extractChannels (const QString &fileName);
+	static Features extractJoint (const QString &fileName);
+	static Features extract (const QString &fileName, bool joint);
+	static bool histograms (const QImage &image, bool joint, QVector<quint16> *column);
+	static float distance (Metric metric, const float *query, const quint16 *entry, int n);
+
+	QStringList names;
+	QVector<quint16> columns [ColumnCount];	// names.size() * bins(column) values each, 65535 = whole image
+	bool joint;
+};
+#endif
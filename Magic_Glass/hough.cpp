@@ -0,0 +1,481 @@
+/*
+	The implementation of hough.h.
+*/
+#include <QtGui>
+#include <cmath>
+#include "hough.h"
+
+namespace
+{
+	enum {Angles = 360, LineAngles = 180, LineWindow = 5};
+
+	// Cosine and sine of every whole degree.
+	struct Trig
+	{
+		Trig()
+		{
+			for (int a = 0; a < Angles; a++)
+			{
+				cosine [a] = (float)std::cos (a * M_PI / 180.0);
+				sine [a] = (float)std::sin (a * M_PI / 180.0);
+			}
+		}
+
+		float cosine [Angles];
+		float sine [Angles];
+	};
+
+	const Trig &trig()
+	{
+		static const Trig t;
+		return t;
+	}
+
+	inline int nearest (float v)
+	{
+		return (int)std::floor (v + 0.5f);
+	}
+
+	// An edge pixel and the direction of its gradient in whole degrees (0 .. 359).
+	struct EdgePoint
+	{
+		int x;
+		int y;
+		int angle;
+	};
+
+	/*
+		Sobel gradient of rows [first, last) of gray; visit (x, y, angle) is called for every
+			pixel whose magnitude reaches the threshold.  The outermost rows and columns are skipped.
+	*/
+	template <class Visit>
+	void edgePixels (const Plane &gray, int magnitude, int first, int last, Visit &visit)
+	{
+		for (int y = qMax (1, first); y < qMin (last, gray.height - 1); y++)
+		{
+			const uchar *p = gray.scanLine (y - 1);
+			const uchar *c = gray.scanLine (y);
+			const uchar *n = gray.scanLine (y + 1);
+			for (int x = 1; x < gray.width - 1; x++)
+			{
+				int gx = (p[x+1] + 2*c[x+1] + n[x+1]) - (p[x-1] + 2*c[x-1] + n[x-1]);
+				int gy = (n[x-1] + 2*n[x] + n[x+1]) - (p[x-1] + 2*p[x] + p[x+1]);
+				if ((gx < 0 ? -gx : gx) + (gy < 0 ? -gy : gy) < magnitude)
+					continue;
+
+				int angle = nearest ((float)(std::atan2 ((double)gy, (double)gx) * 180.0 / M_PI));
+				visit (x, y, (angle + Angles) % Angles);
+			}
+		}
+	}
+
+	// Row bands, one per thread, so every thread fills one accumulator.
+	QList<QPair<int, int> > threadBands (int height)
+	{
+		int bands = qBound (1, QThread::idealThreadCount(), height);
+		QList<QPair<int, int> > rows;
+		for (int b = 0; b < bands; b++)
+			rows << qMakePair (height * b / bands, height * (b + 1) / bands);
+		return rows;
+	}
+
+	// Line votes of one pixel: normals within +-spread degrees of its gradient, at theta (rows) x rho (columns).
+	struct LineVote
+	{
+		void operator() (int x, int y, int angle)
+		{
+			const Trig &t = trig();
+			int theta = angle % LineAngles;
+			for (int d = -spread; d <= spread; d++)
+			{
+				int a = (theta + d + LineAngles) % LineAngles;
+				int rho = nearest (x * t.cosine [a] + y * t.sine [a]);
+				accumulator [a * columns + rho + rhoMax]++;
+			}
+		}
+
+		int *accumulator;
+		int columns;
+		int rhoMax;
+		int spread;
+	};
+
+	struct LineBand
+	{
+		typedef QVector<int> result_type;
+
+		LineBand (const Plane &g, const HoughSettings &s, int r) : gray (g), settings (s), rhoMax (r) {}
+
+		QVector<int> operator() (const QPair<int, int> &rows) const
+		{
+			int columns = 2 * rhoMax + 1;
+			QVector<int> accumulator (LineAngles * columns, 0);
+			LineVote vote = {accumulator.data(), columns, rhoMax, qBound (0, settings.spread, 45)};
+			edgePixels (gray, settings.magnitude, rows.first, rows.second, vote);
+			return accumulator;
+		}
+
+		Plane gray;
+		HoughSettings settings;
+		int rhoMax;
+	};
+
+	// Circle center votes of one pixel: every radius, both ways along its gradient, into 2 x 2 pixel cells.
+	struct CenterVote
+	{
+		void operator() (int x, int y, int angle)
+		{
+			const Trig &t = trig();
+			float cx = t.cosine [angle];
+			float cy = t.sine [angle];
+			for (int r = minRadius; r <= maxRadius; r++)
+			{
+				int dx = nearest (r * cx);
+				int dy = nearest (r * cy);
+				vote (x + dx, y + dy);
+				vote (x - dx, y - dy);
+			}
+			EdgePoint point = {x, y, angle};
+			points -> append (point);
+		}
+
+		void vote (int x, int y)
+		{
+			if (x >= 0 && y >= 0 && x < width && y < height)
+				accumulator [(y >> 1) * cells + (x >> 1)]++;
+		}
+
+		int *accumulator;
+		QVector<EdgePoint> *points;
+		int width;
+		int height;
+		int cells;
+		int minRadius;
+		int maxRadius;
+	};
+
+	struct CenterVotes
+	{
+		QVector<int> accumulator;
+		QVector<EdgePoint> points;
+	};
+
+	struct CenterBand
+	{
+		typedef CenterVotes result_type;
+
+		CenterBand (const Plane &g, const HoughSettings &s) : gray (g), settings (s) {}
+
+		CenterVotes operator() (const QPair<int, int> &rows) const
+		{
+			int cells = (gray.width + 1) / 2;
+			CenterVotes votes;
+			votes.accumulator = QVector<int> (cells * ((gray.height + 1) / 2), 0);
+			CenterVote vote = {votes.accumulator.data(), &votes.points, gray.width, gray.height, cells,
+							   settings.minRadius, settings.maxRadius};
+			edgePixels (gray, settings.magnitude, rows.first, rows.second, vote);
+			return votes;
+		}
+
+		Plane gray;
+		HoughSettings settings;
+	};
+
+	// A local maximum of an accumulator.
+	struct Peak
+	{
+		int index;
+		int votes;
+	};
+
+	bool strongerPeak (const Peak &a, const Peak &b)
+	{
+		return a.votes > b.votes || (a.votes == b.votes && a.index < b.index);
+	}
+
+	// Is cell (row, column) at least as strong as every neighbour (and stronger than those that come first)?
+	inline bool beats (int votes, int index, int other, int otherIndex)
+	{
+		return votes > other || (votes == other && index <= otherIndex);
+	}
+
+	// Number of bits set.
+	inline int bitCount (quint64 bits)
+	{
+		int count = 0;
+		for (; bits; bits &= bits - 1)
+			count++;
+		return count;
+	}
+
+	/*
+		The radius of the circle around a center: every edge pixel at a distance within range whose
+			gradient points at (or away from) the center adds to the count of its distance and marks
+			its direction, one of 64 sectors, as seen.  The radius with the most pixels per unit
+			of circumference wins, if both that and the share of sectors seen reach the coverage;
+			the sectors keep straight edges that pass by from passing for circles.
+	*/
+	struct FitRadius
+	{
+		typedef HoughCircle result_type;
+
+		FitRadius (const QVector<EdgePoint> &p, const HoughSettings &s) : points (p), settings (s) {}
+
+		HoughCircle operator() (const QPointF &center) const
+		{
+			const Trig &t = trig();
+			int minRadius = settings.minRadius;
+			int maxRadius = settings.maxRadius;
+			QVector<int> counts (maxRadius + 2, 0);
+			QVector<quint64> sectors (maxRadius + 2, 0);
+
+			// Points are in row order: find the first row that can be on a circle.
+			int top = (int)std::floor (center.y() - maxRadius - 1);
+			int lo = 0, hi = points.size();
+			while (lo < hi)
+			{
+				int mid = (lo + hi) / 2;
+				if (points [mid].y < top)
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+
+			for (int i = lo; i < points.size() && points [i].y <= center.y() + maxRadius + 1; i++)
+			{
+				double dx = points [i].x - center.x();
+				double dy = points [i].y - center.y();
+				double d = std::sqrt (dx * dx + dy * dy);
+				int r = nearest ((float)d);
+				if (r < minRadius || r > maxRadius)
+					continue;
+				double along = dx * t.cosine [points [i].angle] + dy * t.sine [points [i].angle];
+				if ((along < 0 ? -along : along) >= 0.9 * d)
+				{
+					counts [r]++;
+					sectors [r] |= quint64 (1) << ((int)((std::atan2 (dy, dx) + M_PI) * (32 / M_PI)) & 63);
+				}
+			}
+
+			HoughCircle best = {center.x(), center.y(), 0, 0};
+			double support = 0;
+			for (int r = minRadius; r <= maxRadius; r++)
+			{
+				int votes = counts [r] + counts [r - 1] + counts [r + 1];
+				double s = votes / (2 * M_PI * r);
+				if (s > support && bitCount (sectors [r] | sectors [r - 1] | sectors [r + 1]) >= settings.coverage * 64)
+				{
+					support = s;
+					best.radius = r;
+					best.votes = votes;
+				}
+			}
+			if (support < settings.coverage)
+				best.votes = 0;
+			return best;
+		}
+
+		const QVector<EdgePoint> &points;
+		HoughSettings settings;
+	};
+
+	/*
+		Whether two lines are within turn degrees of each other and cross inside the plane (or,
+			if parallel, lie within the suppression window of each other).
+	*/
+	bool sameLine (const HoughLine &a, const HoughLine &b, int turn, int width, int height)
+	{
+		double angle = std::fabs (a.theta - b.theta) * 180.0 / M_PI;
+		angle = qMin (angle, 180.0 - angle);
+		if (angle > turn)
+			return false;
+
+		double ca = std::cos (a.theta), sa = std::sin (a.theta);
+		double cb = std::cos (b.theta), sb = std::sin (b.theta);
+		double det = ca * sb - sa * cb;
+		if (std::fabs (det) < 1e-9)
+			return std::fabs (a.rho - (ca * cb + sa * sb > 0 ? b.rho : -b.rho)) <= LineWindow;
+
+		double x = (a.rho * sb - b.rho * sa) / det;
+		double y = (ca * b.rho - cb * a.rho) / det;
+		return x >= 0 && y >= 0 && x < width && y < height;
+	}
+
+	bool strongerCircle (const HoughCircle &a, const HoughCircle &b)
+	{
+		return a.votes > b.votes;
+	}
+}
+
+/*
+	Straight lines through the edge pixels of gray, strongest first.  Peaks are suppressed within
+		5 degrees and 5 pixels of a stronger one; near theta = 0 the neighbours on the other
+		side of the wrap (theta + 180 degrees, rho negated) are compared too.  A line that
+		crosses a stronger one inside the plane at less than twice the spread is dropped.
+*/
+QVector<HoughLine> houghLines (const Plane &gray, const HoughSettings &settings)
+{
+	QVector<HoughLine> lines;
+	if (gray.isNull())
+		return lines;
+
+	int rhoMax = (int)std::ceil (std::sqrt ((double)gray.width * gray.width + (double)gray.height * gray.height));
+	int columns = 2 * rhoMax + 1;
+	QList<QVector<int> > parts = QtConcurrent::blockingMapped<QList<QVector<int> > > (threadBands (gray.height),
+																					   LineBand (gray, settings, rhoMax));
+	QVector<int> accumulator = parts [0];
+	int *total = accumulator.data();
+	for (int p = 1; p < parts.size(); p++)
+	{
+		const int *part = parts [p].constData();
+		for (int i = 0; i < accumulator.size(); i++)
+			total [i] += part [i];
+	}
+
+	QVector<Peak> peaks;
+	for (int a = 0; a < LineAngles; a++)
+		for (int c = 0; c < columns; c++)
+		{
+			int index = a * columns + c;
+			int votes = total [index];
+			if (votes < settings.lineVotes)
+				continue;
+
+			bool peak = true;
+			for (int da = -LineWindow; da <= LineWindow && peak; da++)
+			{
+				int na = a + da;
+				int rho = c - rhoMax;
+				if (na < 0 || na >= LineAngles)
+				{
+					na = (na + LineAngles) % LineAngles;
+					rho = -rho;
+				}
+				for (int dr = -LineWindow; dr <= LineWindow && peak; dr++)
+				{
+					int nc = rho + dr + rhoMax;
+					if (nc < 0 || nc >= columns || (da == 0 && dr == 0))
+						continue;
+					int other = na * columns + nc;
+					peak = beats (votes, index, total [other], other);
+				}
+			}
+			if (peak)
+			{
+				Peak p = {index, votes};
+				peaks << p;
+			}
+		}
+
+	// The spread of the votes leaves ridges beside strong lines; drop peaks that are a stronger line seen slightly turned.
+	qSort (peaks.begin(), peaks.end(), strongerPeak);
+	int turn = 2 * qBound (0, settings.spread, 45) + 1;
+	for (int i = 0; i < peaks.size() && lines.size() < settings.maxShapes; i++)
+	{
+		HoughLine line = {double (peaks [i].index % columns - rhoMax), (peaks [i].index / columns) * M_PI / 180.0, peaks [i].votes};
+		bool separate = true;
+		for (int k = 0; k < lines.size() && separate; k++)
+			separate = !sameLine (line, lines [k], turn, gray.width, gray.height);
+		if (separate)
+			lines << line;
+	}
+	return lines;
+}
+
+/*
+	Circles through the edge pixels of gray with radii in [minRadius, maxRadius], strongest first.
+	Center candidates are the local maxima of the center accumulator (refined to the centroid of
+		their 3 x 3 cells); each is given its best radius in parallel and kept if enough of the
+		circle is there.  Of circles whose centers lie within the smaller radius of each other,
+		only the strongest is kept.
+*/
+QVector<HoughCircle> houghCircles (const Plane &gray, const HoughSettings &settings)
+{
+	QVector<HoughCircle> circles;
+	if (gray.isNull() || settings.maxRadius < settings.minRadius || settings.minRadius < 1)
+		return circles;
+
+	QList<CenterVotes> parts = QtConcurrent::blockingMapped<QList<CenterVotes> > (threadBands (gray.height),
+																				   CenterBand (gray, settings));
+	QVector<int> accumulator = parts [0].accumulator;
+	QVector<EdgePoint> points = parts [0].points;
+	int *total = accumulator.data();
+	for (int p = 1; p < parts.size(); p++)
+	{
+		const int *part = parts [p].accumulator.constData();
+		for (int i = 0; i < accumulator.size(); i++)
+			total [i] += part [i];
+		points += parts [p].points;
+	}
+
+	int cells = (gray.width + 1) / 2;
+	int rows = (gray.height + 1) / 2;
+	int window = qMax (2, settings.minRadius / 4);
+	int least = qMax (1, (int)(settings.coverage * M_PI * settings.minRadius));
+
+	QVector<Peak> peaks;
+	for (int j = 0; j < rows; j++)
+		for (int i = 0; i < cells; i++)
+		{
+			int index = j * cells + i;
+			int votes = total [index];
+			if (votes < least)
+				continue;
+
+			bool peak = true;
+			for (int dj = -window; dj <= window && peak; dj++)
+				for (int di = -window; di <= window && peak; di++)
+				{
+					int ni = i + di;
+					int nj = j + dj;
+					if (ni < 0 || nj < 0 || ni >= cells || nj >= rows || (di == 0 && dj == 0))
+						continue;
+					int other = nj * cells + ni;
+					peak = beats (votes, index, total [other], other);
+				}
+			if (peak)
+			{
+				Peak p = {index, votes};
+				peaks << p;
+			}
+		}
+
+	qSort (peaks.begin(), peaks.end(), strongerPeak);
+	QList<QPointF> centers;
+	for (int k = 0; k < peaks.size() && k < 4 * settings.maxShapes; k++)
+	{
+		int i = peaks [k].index % cells;
+		int j = peaks [k].index / cells;
+		double sum = 0, sx = 0, sy = 0;
+		for (int nj = qMax (0, j - 1); nj <= qMin (rows - 1, j + 1); nj++)
+			for (int ni = qMax (0, i - 1); ni <= qMin (cells - 1, i + 1); ni++)
+			{
+				double v = total [nj * cells + ni];
+				sum += v;
+				sx += v * (2 * ni + 0.5);
+				sy += v * (2 * nj + 0.5);
+			}
+		centers << QPointF (sx / sum, sy / sum);
+	}
+
+	QList<HoughCircle> fitted = QtConcurrent::blockingMapped<QList<HoughCircle> > (centers, FitRadius (points, settings));
+	qSort (fitted.begin(), fitted.end(), strongerCircle);
+	for (int k = 0; k < fitted.size() && circles.size() < settings.maxShapes; k++)
+	{
+		const HoughCircle &c = fitted [k];
+		if (c.votes == 0)
+			break;
+
+		bool separate = true;
+		for (int m = 0; m < circles.size() && separate; m++)
+		{
+			double dx = c.x - circles [m].x;
+			double dy = c.y - circles [m].y;
+			double closest = qMin (c.radius, circles [m].radius);
+			separate = dx * dx + dy * dy >= closest * closest;
+		}
+		if (separate)
+			circles << c;
+	}
+	return circles;
+}
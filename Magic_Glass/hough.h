@@ -0,0 +1,51 @@
+/*
+	Hough transforms for straight lines and circles on the gradient of an 8-bit gray plane
+		(the plane the edge views are computed from).
+	A pixel is an edge pixel when its Sobel magnitude |gx| + |gy| reaches the threshold.  Its
+		gradient orientation limits its votes: a line only gets votes for normals within
+		+-spread degrees of the gradient, and a circle center only along the gradient direction
+		(both ways, so bright and dark discs are found).
+	Row bands vote in parallel into accumulators of their own, using cosine and sine lookup
+		tables, and are summed at the end.  Peaks are kept when they reach the vote threshold and
+		are the maximum of their neighbourhood (non-maximum suppression), strongest first.
+	Circles are found in two steps: centers from a half-resolution center accumulator, then the
+		radius of every center from the distances of the edge pixels that face it.
+*/
+#ifndef HOUGH_H
+#define HOUGH_H
+
+#include <QtGui>
+#include "imageview.h"
+
+// x cos (theta) + y sin (theta) = rho, in pixels of the plane; theta in radians, 0 <= theta < pi.
+struct HoughLine
+{
+	double rho;
+	double theta;
+	int votes;
+};
+
+struct HoughCircle
+{
+	double x;
+	double y;
+	double radius;
+	int votes;		// edge pixels on the circle
+};
+
+struct HoughSettings
+{
+	HoughSettings() : magnitude (96), spread (3), lineVotes (60), minRadius (8), maxRadius (64), coverage (0.35), maxShapes (32) {}
+
+	int magnitude;		// minimum Sobel |gx| + |gy| of an edge pixel (0 .. 1020)
+	int spread;			// degrees around the gradient orientation a line pixel votes for
+	int lineVotes;		// minimum votes of a line
+	int minRadius;		// circle radii searched, in pixels
+	int maxRadius;
+	double coverage;	// minimum fraction of a circle's circumference that must be edge pixels
+	int maxShapes;		// at most this many lines or circles, strongest first
+};
+
+QVector<HoughLine> houghLines (const Plane &gray, const HoughSettings &settings);
+QVector<HoughCircle> houghCircles (const Plane &gray, const HoughSettings &settings);
+#endif
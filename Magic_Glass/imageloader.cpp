@@ -0,0 +1,99 @@
+/*
+	The implementation of imageloader.h.
+*/
+#include <QtGui>
+#include "imageloader.h"
+
+ImageLoader::ImageLoader(QObject *parent)
+	: QObject (parent)
+{
+	watcher = 0;
+	generation = started = 0;
+}
+
+/*
+	Decode a version of the file that fits in view.  Images that already fit are decoded at full size.
+	If the reader cannot decode at a reduced size, a gray placeholder of that size is returned
+		instead and the image is only decoded once, by start().
+	fullSize receives the size of the full-resolution image.  Returns a null image if the file
+		cannot be read.
+*/
+QImage ImageLoader::preview (const QString &fileName, const QSize &view, QSize *fullSize)
+{
+	QImageReader reader (fileName);
+	QSize size = reader.size();
+	*fullSize = size;
+
+	if (size.isValid() && view.isValid() && !view.isEmpty()
+		&& (size.width() > view.width() || size.height() > view.height()))
+	{
+		QSize scaled = size;
+		scaled.scale (view, Qt::KeepAspectRatio);
+		if (!reader.supportsOption (QImageIOHandler::ScaledSize))
+		{
+			QImage placeholder (scaled.expandedTo (QSize (1, 1)), QImage::Format_RGB32);
+			placeholder.fill (qRgb (64, 64, 64));
+			return placeholder;
+		}
+		reader.setScaledSize (scaled);
+	}
+
+	QImage image = reader.read();
+	if (!size.isValid())
+		*fullSize = image.size();
+	return image;
+}
+
+// Decode the full-resolution image in the background.
+void ImageLoader::start (const QString &fileName)
+{
+	pending = fileName;
+	generation++;
+
+	if (!watcher)
+	{
+		watcher = new QFutureWatcher<QImage> (this);
+		connect (watcher, SIGNAL (finished()), this, SLOT (decoded()));
+	}
+
+	// One decode at a time; a newer request waits for the running one and replaces it.
+	if (!watcher -> isRunning())
+	{
+		started = generation;
+		watcher -> setFuture (QtConcurrent::run (&ImageLoader::decode, fileName));
+	}
+}
+
+// Forget the pending decode (a decode already running finishes, but its result is dropped).
+void ImageLoader::cancel()
+{
+	generation++;
+	pending = QString();
+}
+
+bool ImageLoader::isLoading() const
+{
+	return !pending.isEmpty();
+}
+
+// Worker thread: the actual full decode.
+QImage ImageLoader::decode (const QString &fileName)
+{
+	QImageReader reader (fileName);
+	return reader.read();
+}
+
+// A decode finished: deliver it if it is still the latest request, otherwise start the latest one.
+void ImageLoader::decoded()
+{
+	if (started == generation)
+	{
+		pending = QString();
+		emit fullImageReady (watcher -> result());
+	}
+	else if (!pending.isEmpty())
+	{
+		started = generation;
+		watcher -> setFuture (QtConcurrent::run (&ImageLoader::decode, pending));
+	}
+}
@@ -0,0 +1,41 @@
+/*
+	Fast-path image loading.
+	preview() decodes a reduced-resolution version sized for the view straight from the file
+		(QImageReader::setScaledSize, which the JPEG reader turns into DCT-domain downscaling),
+		so the first paint does not wait for the full decode.  Readers that cannot decode at a
+		reduced size (PNG, TIFF, ...) would decode the whole image for it, on the GUI thread and
+		again in start(); for them preview() returns a plain placeholder of the preview size.
+	start() then decodes the full-resolution image on a worker thread and emits fullImageReady().
+	Starting another load makes any decode still in flight stale; its result is dropped.
+*/
+#ifndef IMAGELOADER_H
+#define IMAGELOADER_H
+
+#include <QtGui>
+
+class ImageLoader : public QObject
+{
+	Q_OBJECT
+
+public:
+	ImageLoader(QObject *parent = 0);
+	static QImage preview (const QString &fileName, const QSize &view, QSize *fullSize);
+	void start (const QString &fileName);
+	void cancel();
+	bool isLoading() const;
+
+signals:
+	void fullImageReady (const QImage &image);
+
+private slots:
+	void decoded();
+
+private:
+	static QImage decode (const QString &fileName);
+
+	QFutureWatcher<QImage> *watcher;
+	QString pending;
+	int generation;
+	int started;
+};
+#endif
@@ -0,0 +1,131 @@
+/*
+	Non-owning views over pixel memory.
+	ImageView describes a source image (pointer, stride, format, size, color table) so kernels can
+		read straight from whatever buffer holds the pixels without copying it into a new QImage.
+		layout is worked out once here; pixelaccess.h dispatches on it.
+	Sources of 16 bits per sample (Gray16, Rgb48; QImage has no such formats) are described by
+		layout alone and carry a display window: a table taking every sample to the 8-bit level
+		it is shown at.
+	Plane is a writable 8-bit single channel buffer, handed out by FramePool; Plane16 the 16-bit one.
+*/
+#ifndef IMAGEVIEW_H
+#define IMAGEVIEW_H
+
+#include <QtGui>
+
+struct ImageView
+{
+	/*
+		Pixel layouts the kernels read natively.  Gray8 is an 8-bit indexed image with the identity gray palette.
+		Gray16 and Rgb48 hold one and three 16-bit samples per pixel in the machine's byte order.
+	*/
+	enum Layout {Unsupported, Rgb32, Argb32Premultiplied, Rgb888, Indexed8, Gray8, Gray16, Rgb48};
+
+	ImageView()
+		: bits (0), stride (0), format (QImage::Format_Invalid), width (0), height (0), layout (Unsupported),
+		  windowLow (0), windowHigh (0) {}
+	ImageView (const uchar *b, int s, QImage::Format f, int w, int h)
+		: bits (b), stride (s), format (f), width (w), height (h), layout (layoutOf (f, QVector<QRgb>())),
+		  windowLow (0), windowHigh (0) {}
+	explicit ImageView (const QImage &im)
+		: bits (im.bits()), stride (im.bytesPerLine()), format (im.format()), width (im.width()), height (im.height()),
+		  colors (im.colorTable()), layout (layoutOf (im.format(), colors)), windowLow (0), windowHigh (0) {}
+
+	// A 16-bit source, shown with the full 0 .. 65535 window until setWindow() is called.
+	ImageView (const uchar *b, int s, Layout l, int w, int h)
+		: bits (b), stride (s), format (QImage::Format_Invalid), width (w), height (h), layout (l),
+		  windowLow (0), windowHigh (0)
+	{
+		setWindow (0, 65535);
+	}
+
+	bool isNull() const { return bits == 0 || width <= 0 || height <= 0; }
+	bool isDeep() const { return layout == Gray16 || layout == Rgb48; }
+	QSize size() const { return QSize (width, height); }
+	const uchar *scanLine (int y) const { return bits + y * stride; }
+
+	// Show samples up to low as black, from high on as white and those in between on a linear ramp.
+	void setWindow (int low, int high)
+	{
+		windowLow = qBound (0, low, 65534);
+		windowHigh = qBound (windowLow + 1, high, 65535);
+		window.resize (65536);
+		int range = windowHigh - windowLow;
+		for (int v = 0; v < 65536; v++)
+			window [v] = v <= windowLow ? 0 : v >= windowHigh ? 255 : (uchar)(((v - windowLow) * 255 + range / 2) / range);
+	}
+
+	static bool supports (const QImage &im) { return layoutOf (im.format(), im.colorTable()) != Unsupported; }
+
+	static Layout layoutOf (QImage::Format f, const QVector<QRgb> &table)
+	{
+		switch (f)
+		{
+			case QImage::Format_RGB32:
+			case QImage::Format_ARGB32:
+				return Rgb32;
+			case QImage::Format_ARGB32_Premultiplied:
+				return Argb32Premultiplied;
+			case QImage::Format_RGB888:
+				return Rgb888;
+			case QImage::Format_Indexed8:
+				if (table.size() == 256)
+				{
+					int i = 0;
+					while (i < 256 && (table [i] & 0xffffff) == (qRgb (i, i, i) & 0xffffff))
+						i++;
+					if (i == 256)
+						return Gray8;
+				}
+				return Indexed8;
+			default:
+				return Unsupported;
+		}
+	}
+
+	const uchar *bits;
+	int stride;
+	QImage::Format format;
+	int width;
+	int height;
+	QVector<QRgb> colors;
+	Layout layout;
+	QVector<uchar> window;		// display level of every 16-bit sample; empty for 8-bit layouts
+	int windowLow;
+	int windowHigh;
+};
+
+struct Plane
+{
+	Plane()
+		: bits (0), stride (0), width (0), height (0) {}
+	Plane (uchar *b, int s, int w, int h)
+		: bits (b), stride (s), width (w), height (h) {}
+
+	bool isNull() const { return bits == 0 || width <= 0 || height <= 0; }
+	QSize size() const { return QSize (width, height); }
+	uchar *scanLine (int y) const { return bits + y * stride; }
+
+	uchar *bits;
+	int stride;
+	int width;
+	int height;
+};
+
+struct Plane16
+{
+	Plane16()
+		: bits (0), stride (0), width (0), height (0) {}
+	Plane16 (quint16 *b, int s, int w, int h)
+		: bits (b), stride (s), width (w), height (h) {}
+
+	bool isNull() const { return bits == 0 || width <= 0 || height <= 0; }
+	QSize size() const { return QSize (width, height); }
+	quint16 *scanLine (int y) const { return (quint16 *)((uchar *)bits + y * stride); }
+
+	quint16 *bits;
+	int stride;		// in bytes, like Plane
+	int width;
+	int height;
+};
+#endif
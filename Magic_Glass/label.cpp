@@ -27,6 +27,9 @@ Label::Label(QWidget *parent)
 	blueFreq = new QLabel (tr("Blue \n Frequency ="), this);
 	blueFreqValue = new QLabel (this);
 
+	colorFreq = new QLabel (tr("Color \n Frequency ="), this);
+	colorFreqValue = new QLabel (this);
+
 	x = new QLabel (tr("X ="), this);
 	xValue = new QLabel (this);
 	y = new QLabel (tr("Y ="), this);
@@ -57,12 +60,25 @@ Label::Label(QWidget *parent)
 	radius -> setValue (60);
 	radius -> setDisabled (true);
 
+	magLab = new QLabel (tr("Magnification = "), this);
+
+	magnification = new QSpinBox;
+	magnification -> setRange (1, 16);
+	magnification -> setValue (1);
+	magnification -> setSuffix (tr("x"));
+	magnification -> setSpecialValueText (tr("Off"));
+	magnification -> setDisabled (true);
+
+	bicubic = new QCheckBox (tr("Bicubic"), this);
+	bicubic -> setDisabled (true);
+
 	redValue -> setFrameShape (QFrame::StyledPanel);
 	redFreqValue -> setFrameShape (QFrame::StyledPanel);
 	greenValue -> setFrameShape (QFrame::StyledPanel);
 	greenFreqValue -> setFrameShape (QFrame::StyledPanel);
 	blueValue -> setFrameShape (QFrame::StyledPanel);
 	blueFreqValue -> setFrameShape (QFrame::StyledPanel);
+	colorFreqValue -> setFrameShape (QFrame::StyledPanel);
 	xValue -> setFrameShape (QFrame::StyledPanel);
 	yValue -> setFrameShape (QFrame::StyledPanel);
 	blank -> setFrameShape (QFrame::HLine);
@@ -84,25 +100,33 @@ Label::Label(QWidget *parent)
 	layout -> addWidget (blueFreq, 2, 2);
 	layout -> addWidget (blueFreqValue, 2, 3);
 
-	layout -> addWidget (x, 3, 0);
-	layout -> addWidget (xValue, 3, 1);
-	layout -> addWidget (y, 3, 2);
-	layout -> addWidget (yValue, 3, 3);
+	layout -> addWidget (colorFreq, 3, 2);
+	layout -> addWidget (colorFreqValue, 3, 3);
 
-	layout -> addWidget (blank, 4, 0, 1, 4);
-	layout -> addWidget (thres, 5, 0);
-	layout -> addWidget (thresNum, 5, 2);
-	layout -> addWidget (slider, 6, 0, 1, 4);
+	layout -> addWidget (x, 4, 0);
+	layout -> addWidget (xValue, 4, 1);
+	layout -> addWidget (y, 4, 2);
+	layout -> addWidget (yValue, 4, 3);
 
-	layout -> addWidget (blank2, 7, 0, 1, 4);
-	layout -> addWidget (radLab, 8, 0);
-	layout -> addWidget (radius, 8, 2);
+	layout -> addWidget (blank, 5, 0, 1, 4);
+	layout -> addWidget (thres, 6, 0);
+	layout -> addWidget (thresNum, 6, 2);
+	layout -> addWidget (slider, 7, 0, 1, 4);
+
+	layout -> addWidget (blank2, 8, 0, 1, 4);
+	layout -> addWidget (radLab, 9, 0);
+	layout -> addWidget (radius, 9, 2);
+	layout -> addWidget (magLab, 10, 0);
+	layout -> addWidget (magnification, 10, 2);
+	layout -> addWidget (bicubic, 11, 2, 1, 2);
 
 	layout -> setColumnMinimumWidth (3, 45);
 
 	connect (thresNum, SIGNAL (valueChanged(int)), this, SLOT (thresChanged(int)));
 	connect (slider, SIGNAL (valueChanged(int)), this, SLOT (sliderChanged(int)));
 	connect (radius, SIGNAL (valueChanged(int)), this, SLOT (radiusChanged(int)));
+	connect (magnification, SIGNAL (valueChanged(int)), this, SLOT (magnificationChanged(int)));
+	connect (bicubic, SIGNAL (toggled(bool)), this, SLOT (interpolationChanged(bool)));
 
 
 	setLayout (layout);
@@ -115,10 +139,32 @@ void Label::disabledThres()
 	slider -> setEnabled (false);
 }
 
-// When the user enable magic glass, radius slider is enabled.
+// When the user enable magic glass, radius slider and the magnification are enabled.
 void Label::enableMagic (bool ans)
 {
 	radius -> setEnabled (ans);
+	magnification -> setEnabled (ans);
+	bicubic -> setEnabled (ans);
+}
+
+/*
+	Set the glass's radius, magnification and interpolation as if the user had (remote commands
+		and session replay), clamped to the spin box ranges.  The changed signals then apply them
+		to the documents, so the controls always show what the glass does.
+*/
+void Label::setRadius (int value)
+{
+	radius -> setValue (value);
+}
+
+void Label::setMagnification (int value)
+{
+	magnification -> setValue (value);
+}
+
+void Label::setBicubic (bool on)
+{
+	bicubic -> setChecked (on);
 }
 
 
@@ -142,6 +188,33 @@ void Label::histoChanged (int rh, int gh, int bh)
 	blueFreqValue -> setNum (bh);
 }
 
+//	Estimated histogram values with the margins of their 95% confidence intervals, until the exact ones are in.
+void Label::histoEstimated (int rh, int gh, int bh, int rm, int gm, int bm)
+{
+	redFreqValue -> setText (tr("~%1 +/- %2").arg (rh).arg (rm));
+	greenFreqValue -> setText (tr("~%1 +/- %2").arg (gh).arg (gm));
+	blueFreqValue -> setText (tr("~%1 +/- %2").arg (bh).arg (bm));
+}
+
+//	A fuction, which get called by outside the class, that updates the number of pixels with exactly the current color.
+//	A negative count means it is not known (16-bit color images).
+void Label::colorChanged (int count)
+{
+	if (count < 0)
+		colorFreqValue -> setText (tr("n/a"));
+	else
+		colorFreqValue -> setNum (count);
+}
+
+//	The histograms are still being calculated in the background.
+void Label::histoPending()
+{
+	redFreqValue -> setText (tr("pending"));
+	greenFreqValue -> setText (tr("pending"));
+	blueFreqValue -> setText (tr("pending"));
+	colorFreqValue -> setText (tr("pending"));
+}
+
 // Enable threshold level features when the threshold options are checked or in use.
 void Label::enabledThres()
 {
@@ -167,4 +240,16 @@ void Label::radiusChanged (int value)
 {
 	emit changedRadius (value);
 }
+
+// Emit signal about magic glass's magnification change (1 is off).
+void Label::magnificationChanged (int value)
+{
+	emit changedMagnification (value);
+}
+
+// Emit signal about the interpolation of the magnified glass.
+void Label::interpolationChanged (bool checked)
+{
+	emit changedInterpolation (checked);
+}
 //Wai Khoo
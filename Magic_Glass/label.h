@@ -1,7 +1,7 @@
 /*
 	Written by Wai Khoo <wlkhoo@gmail.com>
 	This file create labels which is displayed on the right side of the window.
-	Labels included RGB values, its histogram, the xy coordinates, threshold level, and magic class's radius.
+	Labels included RGB values, its histogram, the xy coordinates, threshold level, and magic class's radius and magnification.
 */
 #ifndef LABEL_H
 #define LABEL_H
@@ -16,20 +16,30 @@ public:
 	Label(QWidget *parent = 0);
 	void disabledThres();
 	void enableMagic(bool ans);
+	void setRadius (int value);
+	void setMagnification (int value);
+	void setBicubic (bool on);
 
 signals:
 	void thresLevelChanged (int value);
 	void changedRadius (int value);
+	void changedMagnification (int value);
+	void changedInterpolation (bool bicubic);
 
 public slots:
 	void valuesChanged (int r, int g, int b, int x, int y);
 	void histoChanged (int rh, int gh, int bh);
+	void histoEstimated (int rh, int gh, int bh, int rm, int gm, int bm);
+	void colorChanged (int count);
+	void histoPending();
 	void enabledThres();
 
 private slots:
 	void thresChanged (int value);
 	void sliderChanged(int value);
 	void radiusChanged(int value);
+	void magnificationChanged (int value);
+	void interpolationChanged (bool checked);
 
 private:
 	QLabel *red;
@@ -47,6 +57,9 @@ private:
 	QLabel *blueFreq;
 	QLabel *blueFreqValue;
 
+	QLabel *colorFreq;
+	QLabel *colorFreqValue;
+
 	QLabel *x;
 	QLabel *xValue;
 	QLabel *y;
@@ -60,7 +73,9 @@ private:
 	QLabel *blank2;
 	QLabel *radLab;
 	QSpinBox *radius;
-
+	QLabel *magLab;
+	QSpinBox *magnification;
+	QCheckBox *bicubic;
 };
 #endif
 //Wai Khoo
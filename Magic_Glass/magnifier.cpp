@@ -0,0 +1,188 @@
+/*
+	The implementation of magnifier.h.
+*/
+#include <QtGui>
+#include <cmath>
+#include "magnifier.h"
+#include "pixelaccess.h"
+#include "rowkernels.h"
+
+namespace
+{
+	// Catmull-Rom weight of a tap at distance d (0 .. 2) from the sample.
+	double cubic (double d)
+	{
+		if (d < 1)
+			return (1.5 * d - 2.5) * d * d + 1;
+		return ((-0.5 * d + 2.5) * d - 4) * d + 2;
+	}
+
+	/*
+		Resamples the rows of the area, each over its span.  The source rows of the taps are blended
+			into 8.8 fixed-point red, green and blue over the source columns the span reads, then
+			the row kernel blends those along the row.
+	*/
+	struct BlendRows
+	{
+		BlendRows (const Magnifier::Axis &c, const Magnifier::Axis &r, int t, const QVector<int> &s, int *b, QRgb *a, int w, int h)
+			: columns (c), rows (r), taps (t), spans (s), blended (b), area (a), width (w), height (h) {}
+
+		template <class Pixels>
+		void operator() (const ImageView &src, const Pixels &pixels)
+		{
+			const RowKernels &kernels = rowKernels();
+			int lines = columns.lines.size();
+			int *red = blended;
+			int *green = blended + lines;
+			int *blue = blended + 2 * lines;
+
+			for (int j = 0; j < height; j++)
+			{
+				int i0 = spans.isEmpty() ? 0 : spans [2 * j];
+				int i1 = spans.isEmpty() ? width - 1 : spans [2 * j + 1];
+				if (i0 > i1)
+					continue;
+
+				const uchar *line [4];
+				const int *wy = rows.weights.constData() + j * taps;
+				for (int t = 0; t < taps; t++)
+					line [t] = src.scanLine (rows.lines [rows.index [j] + t]);
+
+				int last = columns.index [i1] + taps - 1;
+				for (int c = columns.index [i0]; c <= last; c++)
+				{
+					int x = columns.lines [c];
+					int r = 0, g = 0, b = 0;
+					for (int t = 0; t < taps; t++)
+					{
+						QRgb p = pixels (line [t], x);
+						r += wy [t] * qRed (p);
+						g += wy [t] * qGreen (p);
+						b += wy [t] * qBlue (p);
+					}
+					red [c] = r;
+					green [c] = g;
+					blue [c] = b;
+				}
+
+				const int *index = columns.index.constData() + i0;
+				const int *weights = columns.weights.constData() + i0 * taps;
+				QRgb *out = area + j * width + i0;
+				if (taps == 2)
+					kernels.resample2 (red, green, blue, index, weights, out, i1 - i0 + 1);
+				else
+					kernels.resample4 (red, green, blue, index, weights, out, i1 - i0 + 1);
+			}
+		}
+
+		const Magnifier::Axis &columns;
+		const Magnifier::Axis &rows;
+		int taps;
+		const QVector<int> &spans;
+		int *blended;
+		QRgb *area;
+		int width;
+		int height;
+	};
+}
+
+Magnifier::Magnifier()
+{
+	mode = Bilinear;
+}
+
+void Magnifier::setInterpolation (Interpolation interpolation)
+{
+	mode = interpolation;
+}
+
+Magnifier::Interpolation Magnifier::interpolation() const
+{
+	return mode;
+}
+
+/*
+	Resample an area of the given size of any source pixelaccess.h reads; 16-bit sources come
+		out through their display window.  spans holds the first and last column of every row to
+		write, in area coordinates (first above last skips the row); empty writes whole rows.
+	Returns a 32-bit view of the area, valid until the next call.
+*/
+ImageView Magnifier::resample (const ImageView &source, const QSize &area, const QPointF &origin, const QPointF &step, const QVector<int> &spans)
+{
+	if (source.isNull() || area.isEmpty())
+		return ImageView();
+
+	int taps = mode == Bicubic ? 4 : 2;
+	layout (columns, origin.x(), step.x(), area.width(), source.width);
+	layout (rows, origin.y(), step.y(), area.height(), source.height);
+	blended.resize (3 * columns.lines.size());
+	pixels.resize (area.width() * area.height());
+
+	BlendRows blend (columns, rows, taps, spans, blended.data(), pixels.data(), area.width(), area.height());
+	if (!dispatchPixels (source, blend))
+		return ImageView();
+	return ImageView ((const uchar *)pixels.constData(), area.width() * 4, QImage::Format_RGB32, area.width(), area.height());
+}
+
+/*
+	Taps and weights of count pixels along one axis, pixel i sampling the source at origin + i * step
+		of a source limit lines long.  Pixels go in order, so the taps of a pixel that were
+		already listed are the last lines listed, and the rest are appended after them.
+*/
+void Magnifier::layout (Axis &axis, double origin, double step, int count, int limit) const
+{
+	int taps = mode == Bicubic ? 4 : 2;
+	axis.lines.reserve (count * taps);	// keeps the allocation over the resize below
+	axis.lines.resize (0);
+	axis.index.resize (count);
+	axis.weights.resize (count * taps);
+
+	for (int i = 0; i < count; i++)
+	{
+		double u = origin + i * step;
+		int base = (int)std::floor (u);
+		double f = u - base;
+		int *w = axis.weights.data() + i * taps;
+		int first = base;
+
+		if (taps == 2)
+		{
+			w [1] = qRound (f * 256);
+			w [0] = 256 - w [1];
+		}
+		else
+		{
+			first = base - 1;
+			w [0] = qRound (256 * cubic (1 + f));
+			w [1] = qRound (256 * cubic (f));
+			w [2] = qRound (256 * cubic (1 - f));
+			w [3] = qRound (256 * cubic (2 - f));
+			w [f < 0.5 ? 1 : 2] += 256 - (w [0] + w [1] + w [2] + w [3]);
+		}
+
+		int last = axis.lines.isEmpty() ? first - 1 : axis.lines.last();
+		axis.index [i] = axis.lines.size() - qMax (0, last - first + 1);
+		for (int line = qMax (first, last + 1); line < first + taps; line++)
+			axis.lines.append (line);
+	}
+
+	for (int k = 0; k < axis.lines.size(); k++)
+		axis.lines [k] = qBound (0, axis.lines [k], limit - 1);
+}
+
+// Memory held by the tables and the resampled area.
+qint64 Magnifier::bytes() const
+{
+	qint64 ints = columns.lines.capacity() + columns.index.capacity() + columns.weights.capacity()
+				+ rows.lines.capacity() + rows.index.capacity() + rows.weights.capacity() + blended.capacity();
+	return ints * sizeof (int) + (qint64)pixels.capacity() * sizeof (QRgb);
+}
+
+// Free the buffers; they are allocated again by the next resample().
+void Magnifier::release()
+{
+	columns = Axis();
+	rows = Axis();
+	blended = QVector<int>();
+	pixels = QVector<QRgb>();
+}
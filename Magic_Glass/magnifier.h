@@ -0,0 +1,50 @@
+/*
+	Resampling of a small area of a source at a magnification, for the magnifying lens.
+	Pixel (i, j) of the area shows the source at (origin.x + i * step.x, origin.y + j * step.y),
+		in source pixels (a step below 1 magnifies), interpolated bilinearly (2 x 2 taps) or
+		bicubically (Catmull-Rom, 4 x 4 taps) from the source clamped at its edges.
+	The filter is separable: each row first blends the source rows around it over just the
+		source columns its pixels fall between, then blends along the row with a vectorized row
+		kernel (see rowkernels.h).  The work follows the size of the area, not the magnification
+		or the size of the source.
+*/
+#ifndef MAGNIFIER_H
+#define MAGNIFIER_H
+
+#include <QtGui>
+#include "imageview.h"
+
+class Magnifier
+{
+public:
+	enum Interpolation {Bilinear, Bicubic};
+
+	Magnifier();
+	void setInterpolation (Interpolation interpolation);
+	Interpolation interpolation() const;
+	ImageView resample (const ImageView &source, const QSize &area, const QPointF &origin, const QPointF &step, const QVector<int> &spans);
+	qint64 bytes() const;
+	void release();
+
+	/*
+		The source lines one axis of the area reads: for each pixel, the first of its taps as an
+			index into lines (the distinct lines, in order, clamped to the source) and the weights
+			of its taps out of 256.
+	*/
+	struct Axis
+	{
+		QVector<int> lines;
+		QVector<int> index;
+		QVector<int> weights;
+	};
+
+private:
+	void layout (Axis &axis, double origin, double step, int count, int limit) const;
+
+	Interpolation mode;
+	Axis columns;
+	Axis rows;
+	QVector<int> blended;		// rows of the source blended vertically, red, green and blue planes of columns.lines.size()
+	QVector<QRgb> pixels;		// the resampled area
+};
+#endif
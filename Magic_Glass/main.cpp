@@ -4,9 +4,116 @@
 
 #include <QApplication>
 #include "mainwindow.h"
+#include "histoindex.h"
+#include "session.h"
+
+/*
+	Batch mode, no window:
+		--build-index <directory> <index file> [--joint]
+		--query <index file> <image> [--metric l1|chi2|intersection] [--top N]
+*/
+static int batch (const QStringList &args)
+{
+	QTextStream out (stdout);
+	HistoIndex index;
+
+	if (args [1] == "--build-index" && args.size() >= 4)
+	{
+		if (!index.build (args [2], args.contains ("--joint")) || !index.save (args [3]))
+		{
+			out << "Cannot build " << args [3] << " from " << args [2] << endl;
+			return 1;
+		}
+		out << index.size() << " images indexed." << endl;
+		return 0;
+	}
+
+	if (args [1] == "--query" && args.size() >= 4)
+	{
+		HistoIndex::Metric metric = HistoIndex::L1;
+		int top = 10;
+		for (int i = 4; i + 1 < args.size(); i++)
+		{
+			if (args [i] == "--metric")
+				metric = args [i + 1] == "chi2" ? HistoIndex::ChiSquare
+					   : args [i + 1] == "intersection" ? HistoIndex::Intersection : HistoIndex::L1;
+			else if (args [i] == "--top")
+				top = args [i + 1].toInt();
+		}
+
+		QImage image (args [3]);
+		if (!index.load (args [2]) || image.isNull())
+		{
+			out << "Cannot read " << args [2] << " or " << args [3] << endl;
+			return 1;
+		}
+
+		QList<HistoIndex::Match> matches = index.query (image, metric, top);
+		for (int i = 0; i < matches.size(); i++)
+			out << matches [i].distance << "\t" << matches [i].fileName << endl;
+		return 0;
+	}
+
+	out << "Usage: " << args [0] << " --build-index <directory> <index file> [--joint]" << endl
+		<< "       " << args [0] << " --query <index file> <image> [--metric l1|chi2|intersection] [--top N]" << endl;
+	return 1;
+}
+
+/*
+	Session tracing, with the window (see session.h):
+		--record <trace file>
+		--replay <trace file> [--fast] [--latencies <file>]
+*/
+static int session (QApplication &app)
+{
+	QStringList args = app.arguments();
+	QTextStream out (stdout);
+	MainWindow gui;
+
+	if (args [1] == "--record")
+	{
+		SessionRecorder *recorder = new SessionRecorder (&gui);
+		if (!recorder -> start (args [2]))
+		{
+			out << "Cannot write " << args [2] << endl;
+			return 1;
+		}
+		gui.show();
+		return app.exec();
+	}
+
+	gui.show();
+	SessionReplay replay (&gui);
+	if (!replay.run (args [2], args.contains ("--fast")))
+	{
+		out << replay.errorString() << endl;
+		return 1;
+	}
+	out << replay.report();
+
+	int i = args.indexOf ("--latencies");
+	if (i > 0 && i + 1 < args.size() && !replay.writeLatencies (args [i + 1]))
+	{
+		out << "Cannot write " << args [i + 1] << endl;
+		return 1;
+	}
+	return 0;
+}
 
 int main (int argc, char *argv[])
 {
+	if (argc > 2 && (QString (argv [1]) == "--record" || QString (argv [1]) == "--replay"))
+	{
+		QApplication app (argc, argv);
+		return session (app);
+	}
+
+	if (argc > 1 && QString (argv [1]).startsWith ("--"))
+	{
+		QApplication app (argc, argv, false);
+		return batch (app.arguments());
+	}
+
 	QApplication app (argc, argv);
 
 	MainWindow gui;
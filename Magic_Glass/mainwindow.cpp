@@ -7,24 +7,42 @@
 #include "ImagePanel.h"
 #include "label.h"
 #include "histo.h"
+#include "cpufeatures.h"
+#include "commandserver.h"
+#include "edgestream.h"
 
 /*
 	Constructor: laying out the main window and set up appropriate widget in an appropriate place.
+	Every opened image lives in its own tab (an ImagePanel); all of them share one MemoryBudget.
 	Connects all the signals and slots appropriately.
 */
 MainWindow::MainWindow()
 {
-	imagePanel = new ImagePanel;
 	rgb = new Label;
-	histo = new Histo;
+	memory = new MemoryBudget (this);
+	elementPixels = 3;
+	claheColumns = claheRows = 8;
+	rawWidth = 1024;
+	rawFormat = MappedImage::Gray8;
+	claheClip = 2.0;
+
+	documents = new QTabWidget;
+	documents -> setTabsClosable (true);
+	imagePanel = newDocument();
 
 	QWidget *w = new QWidget;
 	QGridLayout *layout = new QGridLayout;
-	layout -> addWidget (imagePanel, 0, 0);
+	layout -> addWidget (documents, 0, 0);
 	layout -> addWidget (rgb, 0, 1);
 	layout -> setColumnMinimumWidth (0, 770);
 	layout -> setColumnMinimumWidth (1, 30);
 
+	browser = new ThumbnailBrowser;
+	browserDock = new QDockWidget (tr("Folder"), this);
+	browserDock -> setWidget (browser);
+	addDockWidget (Qt::BottomDockWidgetArea, browserDock);
+	browserDock -> hide();
+
 	createActions();
 	createMenus();
 	createToolBars();
@@ -35,75 +53,285 @@ MainWindow::MainWindow()
 	w -> setLayout (layout);
 	setCentralWidget (w);
 
-	connect (imagePanel, SIGNAL (labelChanged(int, int, int, int, int)),
-			rgb, SLOT (valuesChanged(int, int, int, int, int)));
+	memoryLabel = new QLabel;
+	statusBar() -> addPermanentWidget (memoryLabel);
+	memoryUsage (memory -> total(), memory -> budget());
+
+	connect (rgb, SIGNAL (thresLevelChanged(int)), this, SLOT (threshold(int)));
+
+	connect (browser, SIGNAL (imageChosen(const QString &, const QImage &, const QSize &)),
+			this, SLOT (openThumbnail(const QString &, const QImage &, const QSize &)));
+
+	connect (documents, SIGNAL (currentChanged(int)), this, SLOT (documentChanged(int)));
+
+	connect (documents, SIGNAL (tabCloseRequested(int)), this, SLOT (closeDocument(int)));
 
-	connect (imagePanel, SIGNAL (displayHisto (int, int, int)),
-			histo, SLOT (showHisto (int, int, int)));
+	connect (memory, SIGNAL (usageChanged(qint64, qint64)), this, SLOT (memoryUsage(qint64, qint64)));
 
-	connect (histo, SIGNAL (histoValue (int, int, int)),
+	server = new CommandServer (this);
+	if (!server -> listen ("MagicGlass"))
+		statusBar() -> showMessage (tr("Remote control is not available."), 5000);
+}
+
+// The document in the current tab.
+ImagePanel *MainWindow::activeDocument() const
+{
+	return imagePanel;
+}
+
+// The shared label on the right.
+Label *MainWindow::label() const
+{
+	return rgb;
+}
+
+QTabWidget *MainWindow::tabs() const
+{
+	return documents;
+}
+
+// The actions that change the view without asking anything; session recording and replay name them by their text.
+QList<QAction *> MainWindow::replayableActions() const
+{
+	QList<QAction *> actions;
+	actions << redAct << greenAct << blueAct << aveGrayScaleAct << lumGrayScaleAct << channelViewActs
+			<< thresAllAct << thresSinAct << noMorphAct << erodeAct << dilateAct << openingAct << closingAct
+			<< rectElementAct << hLineElementAct << vLineElementAct << findRegionsAct << eightConnectedAct
+			<< enMagGlaAct << disMagGlaAct << prewittAct << sobelAct << logAct
+			<< findLinesAct << findCirclesAct << clearShapesAct
+			<< zoomInAct << zoomOutAct << fullScreenAct << closeAct;
+	return actions;
+}
+
+// Create an empty document tab and connect it to the shared label and memory budget.
+ImagePanel *MainWindow::newDocument()
+{
+	ImagePanel *panel = new ImagePanel;
+	panel -> setMemoryBudget (memory);
+
+	connect (panel, SIGNAL (labelChanged(int, int, int, int, int)),
+			rgb, SLOT (valuesChanged(int, int, int, int, int)));
+
+	connect (panel -> histogram(), SIGNAL (histoValue (int, int, int)),
 			rgb, SLOT (histoChanged (int, int, int)));
 
-	connect (rgb, SIGNAL (thresLevelChanged(int)), this, SLOT (threshold(int)));
+	connect (panel -> histogram(), SIGNAL (colorFrequency (int)),
+			rgb, SLOT (colorChanged (int)));
+
+	connect (panel -> histogram(), SIGNAL (histoPending()), rgb, SLOT (histoPending()));
+
+	connect (panel -> histogram(), SIGNAL (histoEstimate (int, int, int, int, int, int)),
+			rgb, SLOT (histoEstimated (int, int, int, int, int, int)));
 
-	connect (rgb, SIGNAL (changedRadius(int)), imagePanel, SLOT (setRadius(int)));
+	connect (rgb, SIGNAL (changedRadius(int)), panel, SLOT (setRadius(int)));
+	connect (rgb, SIGNAL (changedMagnification(int)), panel, SLOT (setMagnification(int)));
+	connect (rgb, SIGNAL (changedInterpolation(bool)), panel, SLOT (setBicubic(bool)));
+
+	documents -> addTab (panel, tr("Untitled"));
+	return panel;
 }
 
 /*
 	Main window open function (to open an image file which format Qt can supports).
+	The image goes into the active tab if it is still empty, otherwise into a new tab.
 	Set appropriate actions to true when a file is opened.
 */
 void MainWindow::open()
 {
 	QString fileName = QFileDialog::getOpenFileName(this, tr("Open File"), QDir::currentPath());
 
-	if (!fileName.isEmpty())
+	if (!fileName.isEmpty() && !openFile (fileName))
+		QMessageBox::information(this, tr("Open"), tr("Cannot open %1.").arg(fileName));
+}
+
+/*
+	Open a headerless raw image (gray or RGB, 8 or 16 bits per sample), asking for its pixel format and size.
+	The height offered is what the file size allows at the chosen width.
+*/
+void MainWindow::openRaw()
+{
+	QString fileName = QFileDialog::getOpenFileName (this, tr("Open Raw Image"), QDir::currentPath());
+	if (fileName.isEmpty())
+		return;
+
+	QStringList formats;
+	formats << tr("8-bit gray") << tr("8-bit RGB") << tr("16-bit gray (little-endian)") << tr("16-bit RGB (little-endian)");
+	bool ok;
+	QString format = QInputDialog::getItem (this, tr("Open Raw Image"), tr("Pixel format:"), formats, rawFormat, false, &ok);
+	if (!ok)
+		return;
+	MappedImage::Format chosen = MappedImage::Format (formats.indexOf (format));
+
+	int width = QInputDialog::getInteger (this, tr("Open Raw Image"), tr("Width in pixels:"), rawWidth, 1, 1 << 20, 1, &ok);
+	if (!ok)
+		return;
+	qint64 rows = QFileInfo (fileName).size() / ((qint64)width * MappedImage::bytesPerPixel (chosen));
+	int height = QInputDialog::getInteger (this, tr("Open Raw Image"), tr("Height in pixels:"), (int)qBound ((qint64)1, rows, (qint64)(1 << 20)), 1, 1 << 20, 1, &ok);
+	if (!ok)
+		return;
+
+	rawFormat = chosen;
+	rawWidth = width;
+	if (!MappedImage::fits (QSize (width, height), chosen))
+		QMessageBox::information (this, tr("Open Raw Image"), tr("%1 x %2 pixels are more than the 2 GB one image can hold.").arg (width).arg (height));
+	else if (!openDocument (fileName, QSize (width, height), chosen))
+		QMessageBox::information (this, tr("Open Raw Image"), tr("%1 does not hold %2 x %3 pixels.").arg (fileName).arg (width).arg (height));
+}
+
+// Show the thumbnails of a folder in the dock at the bottom, for opening its images one after another.
+void MainWindow::browseFolder()
+{
+	QString start = browser -> folder().isEmpty() ? QDir::currentPath() : browser -> folder();
+	QString folder = QFileDialog::getExistingDirectory (this, tr("Browse Folder"), start);
+	if (folder.isEmpty())
+		return;
+	browser -> setFolder (folder);
+	browserDock -> show();
+}
+
+// A thumbnail was activated: open its file, showing the thumbnail until the full image is decoded.
+void MainWindow::openThumbnail(const QString &fileName, const QImage &preview, const QSize &previewSource)
+{
+	if (!openDocument (fileName, QSize(), MappedImage::Gray8, preview, previewSource))
+		QMessageBox::information (this, tr("Open"), tr("Cannot open %1.").arg (fileName));
+}
+
+/*
+	Open a file without asking (also used by the command server).  Returns false, leaving the
+		tabs as they were, if the file cannot be read.
+*/
+bool MainWindow::openFile(const QString &fileName)
+{
+	return openDocument (fileName, QSize(), MappedImage::Gray8);
+}
+
+/*
+	Load a file into the active tab if it is still empty, otherwise into a new tab: a raw file of
+		rawSize pixels in format when rawSize is valid, else any file ImagePanel::load() reads.
+	preview is a thumbnail of an image of previewSource pixels to show first, if there is one.
+*/
+bool MainWindow::openDocument(const QString &fileName, const QSize &rawSize, MappedImage::Format format,
+							  const QImage &preview, const QSize &previewSource)
+{
+	bool created = imagePanel -> hasImage();
+	if (created)
+		documents -> setCurrentWidget (newDocument());	// documentChanged() makes it imagePanel
+	bool loaded = rawSize.isValid() ? imagePanel -> loadRaw (fileName, rawSize, format)
+									: imagePanel -> load (fileName, preview, previewSource);	// shows a view-sized preview, then decodes the rest in the background
+	if (!loaded)
 	{
-		QImage image (fileName);
-		if (image.isNull())
-		{
-			QMessageBox::information(this, tr("Open"), tr("Cannot open %1.").arg(fileName));
-			return;
-		}
-		imagePanel -> show(QPixmap::fromImage(image)); //pass the image pixmap to imagePanel show()
-		histo -> histoCalc (image);				// pass the image to Histo to calculate the histogram.
-		scaleFactor = 1.0;
-
-		zoomInAct -> setEnabled (true);
-		zoomOutAct -> setEnabled (true);
-		histogramAct -> setEnabled (true);
-		disMagicGlass();
+		if (created)
+			closeDocument (documents -> currentIndex());
+		return false;
 	}
+	documents -> setTabText (documents -> currentIndex(), QFileInfo (fileName).fileName());
+
+	zoomInAct -> setEnabled (true);
+	zoomOutAct -> setEnabled (true);
+	histogramAct -> setEnabled (true);
+	disMagicGlass();
+	if (!rawSize.isValid())
+		emit documentOpened (fileName);
+	return true;
 }
 
 /*
 	Zoom in function.  Image can't exceed scale factor 3.
 	This function only passes the scale factor to image panel.
-	Zooming implementation is in image panel class
+	Zooming implementation is in image panel class; it shows a coarse frame until zooming pauses.
 */
 void MainWindow::zoomIn()
 {
+	double scaleFactor = imagePanel -> scaleFactor();
 	if (scaleFactor < 3)
-	{
-		scaleFactor *= 1.25;
-		imagePanel -> scaleImage (scaleFactor);
-	}
+		imagePanel -> previewScale (scaleFactor * 1.25);
 }
 
 /*
 	Zoom out function.  Image can't shrink below scale factor 1/3.
 	This function only passes the scale factor to image panel.
-	Zooming implementation is in image panel class.
+	Zooming implementation is in image panel class; it shows a coarse frame until zooming pauses.
 */
 void MainWindow::zoomOut()
 {
+	double scaleFactor = imagePanel -> scaleFactor();
 	if (scaleFactor > 0.333)
+		imagePanel -> previewScale (scaleFactor * 0.8);
+}
+
+// Close the active document.
+void MainWindow::closeDocument()
+{
+	closeDocument (documents -> currentIndex());
+}
+
+// Close a document tab.  The last tab is only emptied, so there is always a panel to draw on.
+void MainWindow::closeDocument(int index)
+{
+	ImagePanel *panel = qobject_cast<ImagePanel *>(documents -> widget (index));
+	if (!panel)
+		return;
+
+	if (documents -> count() == 1)
+	{
+		panel -> reset();
+		documents -> setTabText (index, tr("Untitled"));
+		disMagicGlass();
+		documentChanged (index);
+		return;
+	}
+
+	documents -> removeTab (index);
+	delete panel;
+}
+
+/*
+	Another tab became active: mark it most recently used, bring back any derived data the memory
+		budget evicted while it was in the background, and match the actions to its state.
+*/
+void MainWindow::documentChanged(int index)
+{
+	ImagePanel *panel = qobject_cast<ImagePanel *>(documents -> widget (index));
+	if (!panel)
+		return;
+
+	imagePanel = panel;
+	memory -> touch (imagePanel);
+	imagePanel -> restoreDerived();
+
+	bool loaded = imagePanel -> hasImage();
+	zoomInAct -> setEnabled (loaded);
+	zoomOutAct -> setEnabled (loaded);
+	histogramAct -> setEnabled (loaded);
+	setMagicActions (loaded && imagePanel -> isMagic());
+	syncActions();
+	if (!loaded)
 	{
-		scaleFactor *= 0.8;
-		imagePanel -> scaleImage (scaleFactor);
+		enMagGlaAct -> setEnabled (false);
+		prewittAct -> setEnabled (false);
+		sobelAct -> setEnabled (false);
+		logAct -> setEnabled (false);
+		for (int i = 0; i < channelViewActs.size(); i++)
+			channelViewActs [i] -> setEnabled (false);
 	}
 }
 
+// Let the user pick the RAM budget shared by all documents.
+void MainWindow::memoryBudget()
+{
+	bool ok;
+	int mb = QInputDialog::getInteger (this, tr("Memory Budget"), tr("Budget for all open images (MB):"),
+										(int)(memory -> budget() / (1024 * 1024)), 64, 1024 * 1024, 64, &ok);
+	if (ok)
+		memory -> setBudget ((qint64)mb * 1024 * 1024);
+}
+
+// Show the memory accountant's total in the status bar.
+void MainWindow::memoryUsage(qint64 used, qint64 budget)
+{
+	memoryLabel -> setText (tr("Memory: %1 / %2 MB").arg (used / (1024 * 1024)).arg (budget / (1024 * 1024)));
+}
+
 // Set main window to full screen.
 void MainWindow::fullScreen()
 {
@@ -119,25 +347,29 @@ void MainWindow::about()
 			"histogram, and edge detection. </p>"
 			"<p>There is also a magic glass feature.  When the feature is turned on, it will only "
 			"process the image within the glass, depending on which image processing technique you picked. </p> "
-			"<p>Any problem(s), please look at readme file </p>"));
+			"<p>Any problem(s), please look at readme file </p>"
+			"<p>Vector code path: %1 </p>").arg (CpuFeatures::name (CpuFeatures::level())));
 }
 
 // Red channel of an image.
 void MainWindow::red()
 {
 	imagePanel -> redBand();
+	setThresholdActions (false);
 }
 
 // Green channel of an image
 void MainWindow::green()
 {
 	imagePanel -> greenBand();
+	setThresholdActions (false);
 }
 
 // Blue channel of an image.
 void MainWindow::blue()
 {
 	imagePanel -> blueBand();
+	setThresholdActions (false);
 }
 
 // Restore back original image and set all channels unchecked and disable threshold feature.
@@ -150,29 +382,64 @@ void MainWindow::restore()
 	lumGrayScaleAct -> setChecked (false);
 	thresAllAct -> setChecked (false);
 	thresSinAct -> setChecked (false);
+	uncheckChannelViews();
 	rgb -> disabledThres();
+	noMorphAct -> setChecked (true);
+	setThresholdActions (false);
+	morphology();
 }
 
 // Gray scale channel (average) of an image.
 void MainWindow::averageGrayScale()
 {
 	imagePanel -> aveGrayScale();
+	setThresholdActions (false);
 }
 
 // Gray scale channel (luminance) of an image.
 void MainWindow::luminanceGrayScale()
 {
 	imagePanel ->lumGrayScale();
+	setThresholdActions (false);
+}
+
+/*
+	Hue, saturation, chroma, Cb, Cr, L*, a*, b*, equalized or CLAHE view of an image, whichever action was triggered.
+	Inside the glass when magic glass is on, else over the whole frame in place of an edge view.
+*/
+void MainWindow::colorChannel()
+{
+	QAction *act = qobject_cast<QAction *>(sender());
+	if (!act)
+		return;
+
+	if (!imagePanel -> isMagic())
+	{
+		prewittAct -> setChecked (false);
+		sobelAct -> setChecked (false);
+		logAct -> setChecked (false);
+	}
+	Histo::Channel channel = Histo::Channel (act -> data().toInt());
+	if (channel == Histo::Adaptive)
+		imagePanel -> setClahe (claheColumns, claheRows, claheClip);
+	imagePanel -> colorSpaceChannel (channel);
+	setThresholdActions (false);
 }
 
-// Allow user to save the histogram, but only in JPG format.
+// Allow user to save the histogram of the active document, but only in JPG format.
 void MainWindow::histogram()
 {
+	if (!imagePanel -> histogram() -> isReady())
+	{
+		QMessageBox::information (this, tr("Magic Glass"), tr("The histogram is still being calculated."));
+		return;
+	}
+
 	QByteArray fileFormat ("JPG");
 	QString initialPath = QDir::currentPath() + "/untitled." + fileFormat;
 	QString fileName = QFileDialog::getSaveFileName (this, tr("Save As"), initialPath, tr("%1 Files (*.%2);;All Files (*)")
 															.arg(QString(fileFormat.toUpper())).arg(QString(fileFormat)));
-	histo -> drawHisto (fileName + ".jpg");
+	imagePanel -> histogram() -> drawHisto (fileName + ".jpg");
 }
 
 // Threshold all bands of an image.
@@ -180,6 +447,7 @@ void MainWindow::thresAll()
 {
 	imagePanel -> thresholdAll();
 	rgb -> enabledThres();
+	setThresholdActions (true);
 }
 
 // Threshold individual band of an image.
@@ -187,6 +455,7 @@ void MainWindow::thresInd()
 {
 	imagePanel -> thresholdSin();
 	rgb -> enabledThres();
+	setThresholdActions (true);
 }
 
 // Let ImagePanel know which threshold to perform and what value.
@@ -199,64 +468,339 @@ void MainWindow::threshold(int value)
 		imagePanel -> thresholdSin();
 }
 
+/*
+	Find the connected bright regions of the thresholded image, outline them on the image and
+		list them (largest first) in a table: area, centroid and bounding box in image pixels.
+*/
+void MainWindow::findRegions()
+{
+	QVector<Component> regions = imagePanel -> findRegions (eightConnectedAct -> isChecked());
+	const int maxRows = 10000;
+
+	QDialog *dialog = new QDialog (this);
+	dialog -> setAttribute (Qt::WA_DeleteOnClose);
+	dialog -> setWindowTitle (regions.size() > maxRows ? tr("%1 Regions (largest %2 listed)").arg (regions.size()).arg (maxRows)
+													   : tr("%1 Regions").arg (regions.size()));
+
+	QTableWidget *table = new QTableWidget (qMin (regions.size(), maxRows), 7, dialog);
+	table -> setHorizontalHeaderLabels (QStringList() << tr("Area") << tr("Centroid X") << tr("Centroid Y")
+										<< tr("Left") << tr("Top") << tr("Width") << tr("Height"));
+	table -> setEditTriggers (QAbstractItemView::NoEditTriggers);
+	for (int i = 0; i < table -> rowCount(); i++)
+	{
+		const Component &c = regions [i];
+		table -> setItem (i, 0, new QTableWidgetItem (QString::number (c.area)));
+		table -> setItem (i, 1, new QTableWidgetItem (QString::number (c.x, 'f', 1)));
+		table -> setItem (i, 2, new QTableWidgetItem (QString::number (c.y, 'f', 1)));
+		table -> setItem (i, 3, new QTableWidgetItem (QString::number (c.bounds.left())));
+		table -> setItem (i, 4, new QTableWidgetItem (QString::number (c.bounds.top())));
+		table -> setItem (i, 5, new QTableWidgetItem (QString::number (c.bounds.width())));
+		table -> setItem (i, 6, new QTableWidgetItem (QString::number (c.bounds.height())));
+	}
+
+	QVBoxLayout *layout = new QVBoxLayout;
+	layout -> addWidget (table);
+	dialog -> setLayout (layout);
+	dialog -> resize (560, 400);
+	dialog -> show();
+}
+
+// Hough lines of the active document's edges, drawn over the image.
+void MainWindow::findLines()
+{
+	int found = imagePanel -> findLines (hough).size();
+	statusBar() -> showMessage (tr("%1 lines found.").arg (found), 5000);
+}
+
+// Hough circles of the active document's edges, drawn over the image.
+void MainWindow::findCircles()
+{
+	int found = imagePanel -> findCircles (hough).size();
+	statusBar() -> showMessage (tr("%1 circles found.").arg (found), 5000);
+}
+
+void MainWindow::clearShapes()
+{
+	imagePanel -> clearShapes();
+}
+
+// Let the user pick the gradient magnitude an edge pixel needs to vote.
+void MainWindow::houghThreshold()
+{
+	bool ok;
+	int magnitude = QInputDialog::getInteger (this, tr("Hough Transform"), tr("Edge magnitude threshold (Sobel):"), hough.magnitude, 1, 1020, 8, &ok);
+	if (ok)
+		hough.magnitude = magnitude;
+}
+
+// Let the user pick the range of circle radii searched.
+void MainWindow::circleRadii()
+{
+	bool ok;
+	int smallest = QInputDialog::getInteger (this, tr("Circle Radii"), tr("Smallest radius (pixels):"), hough.minRadius, 2, 1000, 1, &ok);
+	if (!ok)
+		return;
+	int largest = QInputDialog::getInteger (this, tr("Circle Radii"), tr("Largest radius (pixels):"), qMax (hough.maxRadius, smallest), smallest, 1000, 1, &ok);
+	if (!ok)
+		return;
+	hough.minRadius = smallest;
+	hough.maxRadius = largest;
+}
+
+/*
+	Edge detection straight from a file too large to open, written to a PGM file (see edgestream.h).
+	Nothing is loaded into a tab; the rows are streamed through in batches under a progress dialog.
+*/
+void MainWindow::streamEdges()
+{
+	QString input = QFileDialog::getOpenFileName (this, tr("Edge Detect Large File"), QDir::currentPath(),
+												  tr("PGM/PPM Images (*.pgm *.ppm *.pnm);;All Files (*)"));
+	if (input.isEmpty())
+		return;
+
+	bool ok;
+	QStringList operators;
+	operators << tr("Prewitt Mask") << tr("Sobel Mask") << tr("Laplacian of Gaussian");
+	QString choice = QInputDialog::getItem (this, tr("Edge Detect Large File"), tr("Operator:"), operators, 1, false, &ok);
+	if (!ok)
+		return;
+
+	QString output = QFileDialog::getSaveFileName (this, tr("Save Edges As"), QFileInfo (input).completeBaseName() + "-edges.pgm",
+												   tr("PGM Files (*.pgm);;All Files (*)"));
+	if (output.isEmpty())
+		return;
+
+	EdgeStream stream;
+	if (!stream.open (input, output, EdgeStream::Operator (operators.indexOf (choice))))
+	{
+		QMessageBox::information (this, tr("Magic Glass"), stream.errorString());
+		return;
+	}
+
+	int height = stream.size().height();
+	QProgressDialog progress (tr("Detecting edges in %1...").arg (QFileInfo (input).fileName()), tr("Cancel"), 0, height, this);
+	progress.setWindowModality (Qt::WindowModal);
+	int done = 0;
+	while (done >= 0 && done < height && !progress.wasCanceled())
+	{
+		done = stream.process (256);
+		progress.setValue (qMax (0, done));
+	}
+	stream.close();
+
+	if (done < 0)
+		QMessageBox::information (this, tr("Magic Glass"), stream.errorString());
+	if (done != height)
+		QFile::remove (output);
+	else
+		statusBar() -> showMessage (tr("Edges written to %1.").arg (output), 5000);
+}
+
+// Let the user pick the radius of the median filter run before the edge operators.
+void MainWindow::medianPrefilter()
+{
+	bool ok;
+	int r = QInputDialog::getInteger (this, tr("Median Prefilter"), tr("Radius (0 = off):"), imagePanel -> medianRadius(), 0, 15, 1, &ok);
+	if (ok)
+		imagePanel -> setMedianRadius (r);
+}
+
+// Clean up the threshold views with the morphology operation and structuring element checked in the menu.
+void MainWindow::morphology()
+{
+	Morphology::Operation op = Morphology::None;
+	if (erodeAct -> isChecked())
+		op = Morphology::Erode;
+	else if (dilateAct -> isChecked())
+		op = Morphology::Dilate;
+	else if (openingAct -> isChecked())
+		op = Morphology::Open;
+	else if (closingAct -> isChecked())
+		op = Morphology::Close;
+
+	Morphology::Element element = Morphology::Rectangle;
+	if (hLineElementAct -> isChecked())
+		element = Morphology::HorizontalLine;
+	else if (vLineElementAct -> isChecked())
+		element = Morphology::VerticalLine;
+
+	imagePanel -> setMorphology (op, element, elementPixels);
+}
+
+// Let the user pick the size of the structuring element.
+void MainWindow::elementSize()
+{
+	bool ok;
+	int size = QInputDialog::getInteger (this, tr("Structuring Element"), tr("Size (odd, pixels):"), elementPixels, 1, 101, 2, &ok);
+	if (ok)
+	{
+		elementPixels = size | 1;
+		morphology();
+	}
+}
+
+// Let the user pick the CLAHE tile grid (tiles across, then down).
+void MainWindow::claheGrid()
+{
+	bool ok;
+	int columns = QInputDialog::getInteger (this, tr("CLAHE Tile Grid"), tr("Tiles across:"), claheColumns, 1, 64, 1, &ok);
+	if (!ok)
+		return;
+	int rows = QInputDialog::getInteger (this, tr("CLAHE Tile Grid"), tr("Tiles down:"), claheRows, 1, 64, 1, &ok);
+	if (!ok)
+		return;
+	claheColumns = columns;
+	claheRows = rows;
+	imagePanel -> setClahe (claheColumns, claheRows, claheClip);
+}
+
+// Let the user pick the CLAHE clip limit, as a multiple of the mean histogram bin.
+void MainWindow::claheClipLimit()
+{
+	bool ok;
+	double clip = QInputDialog::getDouble (this, tr("CLAHE Clip Limit"), tr("Clip limit (1 = no change, larger = more contrast):"),
+										   claheClip, 1.0, 64.0, 1, &ok);
+	if (ok)
+	{
+		claheClip = clip;
+		imagePanel -> setClahe (claheColumns, claheRows, claheClip);
+	}
+}
+
+// Choose which 16-bit samples the display shows as black and as white; the rest are spread linearly in between.
+void MainWindow::displayWindow()
+{
+	if (!imagePanel -> isDeep())
+	{
+		QMessageBox::information (this, tr("Display Window"), tr("The display window applies to images with 16-bit samples."));
+		return;
+	}
+
+	bool ok;
+	int low = QInputDialog::getInteger (this, tr("Display Window"), tr("Sample shown as black:"),
+										imagePanel -> windowLow(), 0, 65534, 1, &ok);
+	if (!ok)
+		return;
+	int high = QInputDialog::getInteger (this, tr("Display Window"), tr("Sample shown as white:"),
+										 qMax (imagePanel -> windowHigh(), low + 1), low + 1, 65535, 1, &ok);
+	if (ok)
+		imagePanel -> setWindow (low, high);
+}
+
 // When user enable magic glass, previous "off" features are turn on.
 void MainWindow::enMagicGlass()
 {
-	enMagGlaAct -> setEnabled (false);
-	prewittAct -> setEnabled (false);
-	prewittAct -> setChecked (false);
-	sobelAct -> setEnabled (false);
-	sobelAct -> setChecked (false);
-	logAct -> setEnabled (false);
-	logAct -> setChecked (false);
-	redAct -> setEnabled (true);
+	setMagicActions (true);
 	redAct -> setChecked (true);
-	greenAct -> setEnabled (true);
-	blueAct -> setEnabled (true);
-	aveGrayScaleAct -> setEnabled (true);
-	lumGrayScaleAct -> setEnabled (true);
-	thresAllAct -> setEnabled (true);
-	thresSinAct -> setEnabled (true);
-	disMagGlaAct -> setEnabled (true);
-	rgb -> enableMagic (true);
 	imagePanel -> magic (true);
 }
 
 // When user disable magic glass, all features are turn off except zooming, full screen, and generating histogram.
 void MainWindow::disMagicGlass()
 {
-	enMagGlaAct -> setEnabled (true);
-	prewittAct -> setEnabled (true);
-	sobelAct -> setEnabled (true);
-	logAct -> setEnabled (true);
-	disMagGlaAct -> setEnabled (false);
-	redAct -> setEnabled (false);
-	greenAct -> setEnabled (false);
-	blueAct -> setEnabled (false);
-	aveGrayScaleAct -> setEnabled (false);
-	lumGrayScaleAct -> setEnabled (false);
-	thresAllAct -> setEnabled (false);
-	thresSinAct -> setEnabled (false);
-	rgb -> enableMagic (false);
+	setMagicActions (false);
 	imagePanel -> magic (false);
 	restore();
 }
 
+// Enable the actions that belong to magic glass (on) or to the plain/edge view (off).
+void MainWindow::setMagicActions(bool on)
+{
+	enMagGlaAct -> setEnabled (!on);
+	prewittAct -> setEnabled (!on);
+	sobelAct -> setEnabled (!on);
+	logAct -> setEnabled (!on);
+	if (on)
+	{
+		prewittAct -> setChecked (false);
+		sobelAct -> setChecked (false);
+		logAct -> setChecked (false);
+	}
+	disMagGlaAct -> setEnabled (on);
+	redAct -> setEnabled (on);
+	greenAct -> setEnabled (on);
+	blueAct -> setEnabled (on);
+	aveGrayScaleAct -> setEnabled (on);
+	lumGrayScaleAct -> setEnabled (on);
+	thresAllAct -> setEnabled (on);
+	thresSinAct -> setEnabled (on);
+	for (int i = 0; i < channelViewActs.size(); i++)		// color-space and equalized views work with and without the glass
+		channelViewActs [i] -> setEnabled (true);
+	rgb -> enableMagic (on);
+}
+
+// Enable the actions that only make sense on a threshold view.
+void MainWindow::setThresholdActions(bool on)
+{
+	morphologyMenu -> setEnabled (on);
+	findRegionsAct -> setEnabled (on);
+}
+
+/*
+	Check the view, edge and morphology actions that match what the active document shows, and
+		enable the threshold controls if it shows a threshold view.  The document is left as it is.
+*/
+void MainWindow::syncActions()
+{
+	ImagePanel::View view = imagePanel -> view();
+	redAct -> setChecked (view == ImagePanel::RedView);
+	greenAct -> setChecked (view == ImagePanel::GreenView);
+	blueAct -> setChecked (view == ImagePanel::BlueView);
+	aveGrayScaleAct -> setChecked (view == ImagePanel::AverageView);
+	lumGrayScaleAct -> setChecked (view == ImagePanel::LuminanceView);
+	thresAllAct -> setChecked (view == ImagePanel::ThresholdAllView);
+	thresSinAct -> setChecked (view == ImagePanel::ThresholdBandsView);
+	for (int i = 0; i < channelViewActs.size(); i++)
+		channelViewActs [i] -> setChecked (view == ImagePanel::ChannelView && channelViewActs [i] -> data().toInt() == imagePanel -> channel());
+	prewittAct -> setChecked (view == ImagePanel::PrewittView);
+	sobelAct -> setChecked (view == ImagePanel::SobelView);
+	logAct -> setChecked (view == ImagePanel::LoGView);
+
+	bool thresholding = view == ImagePanel::ThresholdAllView || view == ImagePanel::ThresholdBandsView;
+	if (thresholding)
+		rgb -> enabledThres();
+	else
+		rgb -> disabledThres();
+	setThresholdActions (thresholding);
+
+	Morphology::Operation op = imagePanel -> morphologyOperation();
+	noMorphAct -> setChecked (op == Morphology::None);
+	erodeAct -> setChecked (op == Morphology::Erode);
+	dilateAct -> setChecked (op == Morphology::Dilate);
+	openingAct -> setChecked (op == Morphology::Open);
+	closingAct -> setChecked (op == Morphology::Close);
+	Morphology::Element element = imagePanel -> morphologyElement();
+	rectElementAct -> setChecked (element == Morphology::Rectangle);
+	hLineElementAct -> setChecked (element == Morphology::HorizontalLine);
+	vLineElementAct -> setChecked (element == Morphology::VerticalLine);
+	elementPixels = imagePanel -> morphologySize();
+}
+
+// The edge views replace a whole-frame color-space or equalized view.
+void MainWindow::uncheckChannelViews()
+{
+	for (int i = 0; i < channelViewActs.size(); i++)
+		channelViewActs [i] -> setChecked (false);
+}
+
 // Prewitt edge detection.
 void MainWindow::prewitt()
 {
+	uncheckChannelViews();
 	imagePanel -> prewittM();
 }
 
 // Sobel edge detection.
 void MainWindow::sobel()
 {
+	uncheckChannelViews();
 	imagePanel -> sobelM();
 }
 
 // Laplacian of Gaussian edge detection.
 void MainWindow::LoG()
 {
+	uncheckChannelViews();
 	imagePanel -> LoGM();
 }
 
@@ -292,6 +836,29 @@ void MainWindow::createActions()
 	lumGrayScaleAct -> setCheckable (true);
 	connect (lumGrayScaleAct, SIGNAL (triggered()), this, SLOT (luminanceGrayScale()));
 
+	QStringList spaceNames;
+	spaceNames << tr("Hue") << tr("Saturation") << tr("Chroma") << tr("Cb (Blue Difference)") << tr("Cr (Red Difference)")
+			   << tr("L* (Lightness)") << tr("a* (Green-Red)") << tr("b* (Blue-Yellow)")
+			   << tr("Histogram Equalization") << tr("CLAHE (Adaptive Equalization)");
+	for (int i = 0; i < spaceNames.size(); i++)
+	{
+		QAction *act = new QAction (spaceNames [i], this);
+		act -> setData (Histo::Hue + i);
+		act -> setEnabled (false);
+		act -> setCheckable (true);
+		connect (act, SIGNAL (triggered()), this, SLOT (colorChannel()));
+		channelViewActs << act;
+	}
+
+	claheGridAct = new QAction (tr("CLAHE Tile Grid..."), this);
+	connect (claheGridAct, SIGNAL (triggered()), this, SLOT (claheGrid()));
+
+	claheClipAct = new QAction (tr("CLAHE Clip Limit..."), this);
+	connect (claheClipAct, SIGNAL (triggered()), this, SLOT (claheClipLimit()));
+
+	windowAct = new QAction (tr("Display &Window..."), this);
+	connect (windowAct, SIGNAL (triggered()), this, SLOT (displayWindow()));
+
 	histogramAct = new QAction (tr("Generate a histogram"), this);
 	histogramAct -> setShortcut (tr("Ctrl+H"));
 	histogramAct -> setEnabled (false);
@@ -334,10 +901,90 @@ void MainWindow::createActions()
 	logAct -> setCheckable (true);
 	connect (logAct, SIGNAL (triggered()), this, SLOT (LoG()));
 
+	findRegionsAct = new QAction (tr("Find &Regions"), this);
+	findRegionsAct -> setShortcut (tr("Ctrl+E"));
+	findRegionsAct -> setEnabled (false);
+	connect (findRegionsAct, SIGNAL (triggered()), this, SLOT (findRegions()));
+
+	eightConnectedAct = new QAction (tr("8-Connected Regions"), this);
+	eightConnectedAct -> setCheckable (true);
+	eightConnectedAct -> setChecked (true);
+
+	medianAct = new QAction (tr("Median Prefilter..."), this);
+	connect (medianAct, SIGNAL (triggered()), this, SLOT (medianPrefilter()));
+
+	findLinesAct = new QAction (tr("Find &Lines"), this);
+	connect (findLinesAct, SIGNAL (triggered()), this, SLOT (findLines()));
+
+	findCirclesAct = new QAction (tr("Find &Circles"), this);
+	connect (findCirclesAct, SIGNAL (triggered()), this, SLOT (findCircles()));
+
+	clearShapesAct = new QAction (tr("Clear Lines and Circles"), this);
+	connect (clearShapesAct, SIGNAL (triggered()), this, SLOT (clearShapes()));
+
+	houghThresholdAct = new QAction (tr("Hough Edge Threshold..."), this);
+	connect (houghThresholdAct, SIGNAL (triggered()), this, SLOT (houghThreshold()));
+
+	circleRadiiAct = new QAction (tr("Circle Radii..."), this);
+	connect (circleRadiiAct, SIGNAL (triggered()), this, SLOT (circleRadii()));
+
+	noMorphAct = new QAction (tr("None"), this);
+	noMorphAct -> setCheckable (true);
+	noMorphAct -> setChecked (true);
+	connect (noMorphAct, SIGNAL (triggered()), this, SLOT (morphology()));
+
+	erodeAct = new QAction (tr("Erode"), this);
+	erodeAct -> setCheckable (true);
+	connect (erodeAct, SIGNAL (triggered()), this, SLOT (morphology()));
+
+	dilateAct = new QAction (tr("Dilate"), this);
+	dilateAct -> setCheckable (true);
+	connect (dilateAct, SIGNAL (triggered()), this, SLOT (morphology()));
+
+	openingAct = new QAction (tr("Open"), this);
+	openingAct -> setCheckable (true);
+	connect (openingAct, SIGNAL (triggered()), this, SLOT (morphology()));
+
+	closingAct = new QAction (tr("Close"), this);
+	closingAct -> setCheckable (true);
+	connect (closingAct, SIGNAL (triggered()), this, SLOT (morphology()));
+
+	rectElementAct = new QAction (tr("Rectangle"), this);
+	rectElementAct -> setCheckable (true);
+	rectElementAct -> setChecked (true);
+	connect (rectElementAct, SIGNAL (triggered()), this, SLOT (morphology()));
+
+	hLineElementAct = new QAction (tr("Horizontal Line"), this);
+	hLineElementAct -> setCheckable (true);
+	connect (hLineElementAct, SIGNAL (triggered()), this, SLOT (morphology()));
+
+	vLineElementAct = new QAction (tr("Vertical Line"), this);
+	vLineElementAct -> setCheckable (true);
+	connect (vLineElementAct, SIGNAL (triggered()), this, SLOT (morphology()));
+
+	elementSizeAct = new QAction (tr("Element Size..."), this);
+	connect (elementSizeAct, SIGNAL (triggered()), this, SLOT (elementSize()));
+
 	openAct = new QAction (tr("&Open"), this);
 	openAct -> setShortcut (tr("Ctrl+O"));
 	connect (openAct, SIGNAL(triggered()), this, SLOT (open()));
 
+	openRawAct = new QAction (tr("Open &Raw..."), this);
+	connect (openRawAct, SIGNAL(triggered()), this, SLOT (openRaw()));
+
+	browseAct = new QAction (tr("Browse &Folder..."), this);
+	connect (browseAct, SIGNAL(triggered()), this, SLOT (browseFolder()));
+
+	closeAct = new QAction (tr("&Close"), this);
+	closeAct -> setShortcut (tr("Ctrl+W"));
+	connect (closeAct, SIGNAL(triggered()), this, SLOT (closeDocument()));
+
+	budgetAct = new QAction (tr("Memory &Budget..."), this);
+	connect (budgetAct, SIGNAL(triggered()), this, SLOT (memoryBudget()));
+
+	streamEdgesAct = new QAction (tr("Edge Detect &Large File..."), this);
+	connect (streamEdgesAct, SIGNAL(triggered()), this, SLOT (streamEdges()));
+
 	exitAct = new QAction (tr("&Exit"), this);
 	exitAct -> setShortcut (tr("Ctrl+Q"));
 	connect (exitAct, SIGNAL(triggered()), this, SLOT (close()));
@@ -371,6 +1018,8 @@ void MainWindow::createActions()
 	bandGroup -> addAction (lumGrayScaleAct);
 	bandGroup -> addAction (thresAllAct);
 	bandGroup -> addAction (thresSinAct);
+	for (int i = 0; i < channelViewActs.size(); i++)
+		bandGroup -> addAction (channelViewActs [i]);
 	bandGroup -> setExclusive (true);
 	bandGroup -> setVisible (true);
 
@@ -380,6 +1029,20 @@ void MainWindow::createActions()
 	edgeDetectionGroup -> addAction (logAct);
 	edgeDetectionGroup -> setExclusive (true);
 	edgeDetectionGroup -> setVisible (true);
+
+	morphologyGroup = new QActionGroup (this);
+	morphologyGroup -> addAction (noMorphAct);
+	morphologyGroup -> addAction (erodeAct);
+	morphologyGroup -> addAction (dilateAct);
+	morphologyGroup -> addAction (openingAct);
+	morphologyGroup -> addAction (closingAct);
+	morphologyGroup -> setExclusive (true);
+
+	elementGroup = new QActionGroup (this);
+	elementGroup -> addAction (rectElementAct);
+	elementGroup -> addAction (hLineElementAct);
+	elementGroup -> addAction (vLineElementAct);
+	elementGroup -> setExclusive (true);
 }
 
 void MainWindow::createMenus()
@@ -392,21 +1055,68 @@ void MainWindow::createMenus()
 	bandChannelMenu -> addAction (aveGrayScaleAct);
 	bandChannelMenu -> addAction (lumGrayScaleAct);
 
+	colorSpaceMenu = new QMenu (tr("Color &Space"), this);
+	for (int i = 0; i <= Histo::BStar - Histo::Hue; i++)
+	{
+		if (i == 3 || i == 5)		// HSV | YCbCr | L*a*b*
+			colorSpaceMenu -> addSeparator();
+		colorSpaceMenu -> addAction (channelViewActs [i]);
+	}
+
+	enhanceMenu = new QMenu (tr("&Enhance"), this);
+	enhanceMenu -> addAction (channelViewActs [Histo::Equalize - Histo::Hue]);
+	enhanceMenu -> addAction (channelViewActs [Histo::Adaptive - Histo::Hue]);
+	enhanceMenu -> addSeparator();
+	enhanceMenu -> addAction (claheGridAct);
+	enhanceMenu -> addAction (claheClipAct);
+	enhanceMenu -> addSeparator();
+	enhanceMenu -> addAction (windowAct);
+
 	thresholdMenu = new QMenu (tr("&Threshold"), this);
 	thresholdMenu -> addAction (thresAllAct);
 	thresholdMenu -> addAction (thresSinAct);
+	thresholdMenu -> addSeparator();
+	thresholdMenu -> addAction (findRegionsAct);
+	thresholdMenu -> addAction (eightConnectedAct);
+
+	morphologyMenu = new QMenu (tr("&Morphology"), this);
+	morphologyMenu -> addAction (noMorphAct);
+	morphologyMenu -> addAction (erodeAct);
+	morphologyMenu -> addAction (dilateAct);
+	morphologyMenu -> addAction (openingAct);
+	morphologyMenu -> addAction (closingAct);
+	morphologyMenu -> addSeparator();
+	morphologyMenu -> addAction (rectElementAct);
+	morphologyMenu -> addAction (hLineElementAct);
+	morphologyMenu -> addAction (vLineElementAct);
+	morphologyMenu -> addAction (elementSizeAct);
+	morphologyMenu -> setEnabled (false);
 
 	edgeDetMenu = new QMenu (tr("Edge Detection"), this);
 	edgeDetMenu -> addAction (prewittAct);
 	edgeDetMenu -> addAction (sobelAct);
 	edgeDetMenu -> addAction (logAct);
+	edgeDetMenu -> addSeparator();
+	edgeDetMenu -> addAction (medianAct);
+	edgeDetMenu -> addSeparator();
+	edgeDetMenu -> addAction (findLinesAct);
+	edgeDetMenu -> addAction (findCirclesAct);
+	edgeDetMenu -> addAction (clearShapesAct);
+	edgeDetMenu -> addAction (houghThresholdAct);
+	edgeDetMenu -> addAction (circleRadiiAct);
 
 	fileMenu = new QMenu (tr("&File"), this);
 	fileMenu -> addAction (openAct);
+	fileMenu -> addAction (openRawAct);
+	fileMenu -> addAction (browseAct);
+	fileMenu -> addAction (closeAct);
 	fileMenu -> addAction (histogramAct);
 	fileMenu -> addAction (enMagGlaAct);
 	fileMenu -> addAction (disMagGlaAct);
 	fileMenu -> addSeparator();
+	fileMenu -> addAction (budgetAct);
+	fileMenu -> addAction (streamEdgesAct);
+	fileMenu -> addSeparator();
 	fileMenu -> addAction (exitAct);
 
 	viewMenu = new QMenu (tr("&View"), this);
@@ -414,9 +1124,13 @@ void MainWindow::createMenus()
 	viewMenu -> addSeparator();
 	viewMenu -> addAction (zoomInAct);
 	viewMenu -> addAction (zoomOutAct);
+	viewMenu -> addAction (browserDock -> toggleViewAction());
 	viewMenu -> addSeparator();
 	viewMenu -> addMenu (bandChannelMenu);
+	viewMenu -> addMenu (colorSpaceMenu);
+	viewMenu -> addMenu (enhanceMenu);
 	viewMenu -> addMenu (thresholdMenu);
+	viewMenu -> addMenu (morphologyMenu);
 	viewMenu -> addSeparator();
 	viewMenu -> addMenu (edgeDetMenu);
 
@@ -10,6 +10,10 @@
 #include "ImagePanel.h"
 #include "label.h"
 #include "histo.h"
+#include "memorybudget.h"
+#include "thumbnailbrowser.h"
+
+class CommandServer;
 
 class MainWindow : public QMainWindow
 {
@@ -17,9 +21,27 @@ class MainWindow : public QMainWindow
 
 public:
 	MainWindow();
+	ImagePanel *activeDocument() const;
+	Label *label() const;
+	QTabWidget *tabs() const;
+	QList<QAction *> replayableActions() const;
+
+public slots:
+	bool openFile(const QString &fileName);
+
+signals:
+	void documentOpened (const QString &fileName);
 
 private slots:
 	void open();
+	void openRaw();
+	void browseFolder();
+	void openThumbnail(const QString &fileName, const QImage &preview, const QSize &previewSource);
+	void closeDocument();
+	void closeDocument(int index);
+	void documentChanged(int index);
+	void memoryBudget();
+	void memoryUsage(qint64 used, qint64 budget);
 	void zoomIn();
 	void zoomOut();
 	void fullScreen();
@@ -30,10 +52,24 @@ private slots:
 	void restore();
 	void averageGrayScale();
 	void luminanceGrayScale();
+	void colorChannel();
 	void histogram();
 	void thresAll();
 	void thresInd();
 	void threshold(int value);
+	void morphology();
+	void elementSize();
+	void claheGrid();
+	void claheClipLimit();
+	void displayWindow();
+	void medianPrefilter();
+	void streamEdges();
+	void findLines();
+	void findCircles();
+	void clearShapes();
+	void houghThreshold();
+	void circleRadii();
+	void findRegions();
 	void enMagicGlass();
 	void disMagicGlass();
 	void prewitt();
@@ -44,19 +80,37 @@ private:
 	void createActions();
 	void createMenus();
 	void createToolBars();
+	ImagePanel *newDocument();
+	bool openDocument(const QString &fileName, const QSize &rawSize, MappedImage::Format format,
+					  const QImage &preview = QImage(), const QSize &previewSource = QSize());
+	void setMagicActions(bool on);
+	void setThresholdActions(bool on);
+	void uncheckChannelViews();
+	void syncActions();
 
-	Histo *histo;
-	ImagePanel *imagePanel;
+	ImagePanel *imagePanel;		// the active document
+	QTabWidget *documents;
+	MemoryBudget *memory;
+	CommandServer *server;
 	Label *rgb;
-	double scaleFactor;
+	QLabel *memoryLabel;
+	ThumbnailBrowser *browser;
+	QDockWidget *browserDock;
 
 	QActionGroup *bandGroup;
 	QActionGroup *edgeDetectionGroup;
+	QActionGroup *morphologyGroup;
+	QActionGroup *elementGroup;
 
 	QAction *redAct;
 	QAction *greenAct;
 	QAction *blueAct;
 	QAction *openAct;
+	QAction *openRawAct;
+	QAction *browseAct;
+	QAction *closeAct;
+	QAction *budgetAct;
+	QAction *streamEdgesAct;
 	QAction *exitAct;
 	QAction *zoomInAct;
 	QAction *zoomOutAct;
@@ -73,6 +127,34 @@ private:
 	QAction *prewittAct;
 	QAction *sobelAct;
 	QAction *logAct;
+	QAction *medianAct;
+	QAction *findLinesAct;
+	QAction *findCirclesAct;
+	QAction *clearShapesAct;
+	QAction *houghThresholdAct;
+	QAction *circleRadiiAct;
+	QAction *findRegionsAct;
+	QAction *eightConnectedAct;
+	QAction *noMorphAct;
+	QAction *erodeAct;
+	QAction *dilateAct;
+	QAction *openingAct;
+	QAction *closingAct;
+	QAction *rectElementAct;
+	QAction *hLineElementAct;
+	QAction *vLineElementAct;
+	QAction *elementSizeAct;
+	QAction *claheGridAct;
+	QAction *claheClipAct;
+	QAction *windowAct;
+	QList<QAction *> channelViewActs;	// hue ... b*, equalize, CLAHE; each carries its Histo::Channel as data
+	int elementPixels;
+	int claheColumns;
+	int claheRows;
+	double claheClip;
+	int rawWidth;
+	int rawFormat;
+	HoughSettings hough;
 
 	QToolBar *viewToolBar;
 
@@ -82,6 +164,9 @@ private:
 	QMenu *bandChannelMenu;
 	QMenu *thresholdMenu;
 	QMenu *edgeDetMenu;
+	QMenu *morphologyMenu;
+	QMenu *colorSpaceMenu;
+	QMenu *enhanceMenu;
 };
 #endif
 // Wai Khoo
@@ -0,0 +1,213 @@
+/*
+	The implementation of mappedimage.h.
+*/
+#include <QtGui>
+#include "mappedimage.h"
+
+MappedImage::MappedImage()
+	: bits (0), maxval (0)
+{
+}
+
+MappedImage::~MappedImage()
+{
+	close();
+}
+
+/*
+	Map a binary PGM or PPM file.  Returns false, with errorString() set, if the file is not one
+		(ASCII netpbm files are left to QImageReader) or is shorter than its header says.
+	Files with a maxval above 255 hold two bytes per sample; maxValue() is that maxval.
+	8-bit gray with a lower maxval is shown through a palette that stretches it to 0 .. 255; 8-bit
+		RGB has no such palette, so only a maxval of 255 is mapped and the rest is left to
+		QImageReader, which scales it.
+*/
+bool MappedImage::openNetpbm (const QString &fileName)
+{
+	if (!open (fileName))
+		return false;
+
+	// Header: magic, width, height and maxval separated by whitespace and comments, then one whitespace byte.
+	const uchar *p = bits;
+	const uchar *end = bits + file.size();
+	if (end - p < 2 || p [0] != 'P' || (p [1] != '5' && p [1] != '6'))
+		return fail (tr("%1 is not a binary PGM or PPM file.").arg (fileName));
+	bool gray = p [1] == '5';
+	p += 2;
+
+	qint64 values [3];
+	for (int i = 0; i < 3; i++)
+	{
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' || *p == '#'))
+		{
+			if (*p == '#')
+				while (p < end && *p != '\n')
+					p++;
+			else
+				p++;
+		}
+
+		values [i] = 0;
+		if (p == end || *p < '0' || *p > '9')
+			return fail (tr("%1 has a damaged header.").arg (fileName));
+		while (p < end && *p >= '0' && *p <= '9' && values [i] < (1 << 30))
+			values [i] = values [i] * 10 + (*p++ - '0');
+	}
+
+	if (values [2] < 1 || values [2] > 65535)
+		return fail (tr("%1 has a damaged header.").arg (fileName));
+	if (!gray && values [2] < 255)
+		return fail (tr("%1 has a maxval of %2, not 255.").arg (fileName).arg (values [2]));
+	Format format = values [2] > 255 ? (gray ? Gray16 : Rgb48) : (gray ? Gray8 : Rgb888);
+	return wrap (p + 1 - bits, (int)values [0], (int)values [1], format, true, (int)values [2]);
+}
+
+// Map a headerless file of size pixels in format, starting offset bytes into the file.  16-bit samples are little-endian.
+bool MappedImage::openRaw (const QString &fileName, const QSize &size, Format format, qint64 offset)
+{
+	return open (fileName) && wrap (offset, size.width(), size.height(), format, false, bytesPerPixel (format) % 2 ? 255 : 65535);
+}
+
+// Drop the image and unmap the file.
+void MappedImage::close()
+{
+	wrapped = QImage();
+	source = ImageView();
+	swapped = QVector<quint16>();
+	maxval = 0;
+	if (bits)
+		file.unmap (bits);
+	bits = 0;
+	file.close();
+}
+
+// The mapped pixels as an image; null unless they are 8-bit RGB.
+const QImage &MappedImage::image() const
+{
+	return wrapped;
+}
+
+// The pixels in any format; null if nothing is open.
+const ImageView &MappedImage::view() const
+{
+	return source;
+}
+
+// The largest sample value the file may hold: up to 255 for 8-bit samples, up to 65535 for 16-bit ones.
+int MappedImage::maxValue() const
+{
+	return maxval;
+}
+
+// Heap memory held for the pixels: only the byte-swapped copy of 16-bit samples, if one was needed.
+qint64 MappedImage::heapBytes() const
+{
+	return (qint64)swapped.size() * sizeof (quint16);
+}
+
+QString MappedImage::errorString() const
+{
+	return error;
+}
+
+// Whether size pixels in format come to at most INT_MAX bytes, the most an image can hold.
+bool MappedImage::fits (const QSize &size, Format format)
+{
+	return (qint64)size.width() * bytesPerPixel (format) * size.height() <= INT_MAX;
+}
+
+int MappedImage::bytesPerPixel (Format format)
+{
+	switch (format)
+	{
+		case Gray8:
+			return 1;
+		case Rgb888:
+			return 3;
+		case Gray16:
+			return 2;
+		default:
+			return 6;
+	}
+}
+
+bool MappedImage::open (const QString &fileName)
+{
+	close();
+	file.setFileName (fileName);
+	if (!file.open (QIODevice::ReadOnly))
+		return fail (tr("Cannot read %1.").arg (fileName));
+	bits = file.size() > 0 ? file.map (0, file.size()) : 0;
+	if (!bits)
+		return fail (tr("Cannot map %1 into memory.").arg (fileName));
+	return true;
+}
+
+/*
+	Wrap width x height pixels starting at offset, rows packed without padding, with samples up to maxValue.
+	8-bit gray is only described by the view, with a palette taking maxValue to white: setting a
+		palette on a QImage over read-only data would copy it.  8-bit RGB is also wrapped in a
+		read-only QImage, which copies the pixels out before anything is written to them.
+	16-bit samples stored in the other byte order (or at an odd offset) are copied out swapped
+		and the file is unmapped again.
+*/
+bool MappedImage::wrap (qint64 offset, int width, int height, Format format, bool bigEndian, int maxValue)
+{
+	if (width < 1 || height < 1 || offset < 0)
+		return fail (tr("%1 does not hold %2 x %3 pixels.").arg (file.fileName()).arg (width).arg (height));
+	if (!fits (QSize (width, height), format))
+		return fail (tr("%1 has %2 x %3 pixels, more than the 2 GB one image can hold.").arg (file.fileName()).arg (width).arg (height));
+	int stride = width * bytesPerPixel (format);
+	if (offset + (qint64)stride * height > file.size())
+		return fail (tr("%1 does not hold %2 x %3 pixels.").arg (file.fileName()).arg (width).arg (height));
+
+	if (format == Gray16 || format == Rgb48)
+	{
+		const uchar *start = bits + offset;
+		if (bigEndian != (QSysInfo::ByteOrder == QSysInfo::BigEndian) || (offset & 1))
+		{
+			int count = stride / 2 * height;
+			swapped.resize (count);
+			quint16 *out = swapped.data();
+			int high = bigEndian ? 0 : 1;
+			for (int i = 0; i < count; i++)
+				out [i] = (quint16)(start [2 * i + high] << 8 | start [2 * i + 1 - high]);
+			file.unmap (bits);
+			bits = 0;
+			start = (const uchar *)swapped.constData();
+		}
+		source = ImageView (start, stride, format == Gray16 ? ImageView::Gray16 : ImageView::Rgb48, width, height);
+		maxval = maxValue;
+		error.clear();
+		return true;
+	}
+
+	const uchar *start = bits + offset;
+	if (format == Gray8)
+	{
+		source = ImageView (start, stride, QImage::Format_Indexed8, width, height);
+		source.colors.resize (256);
+		for (int i = 0; i < 256; i++)
+		{
+			int level = qMin (255, i * 255 / maxValue);
+			source.colors [i] = qRgb (level, level, level);
+		}
+		source.layout = ImageView::layoutOf (source.format, source.colors);
+	}
+	else
+	{
+		wrapped = QImage (start, width, height, stride, QImage::Format_RGB888);
+		source = ImageView (wrapped);
+	}
+
+	maxval = maxValue;
+	error.clear();
+	return true;
+}
+
+bool MappedImage::fail (const QString &message)
+{
+	close();
+	error = message;
+	return false;
+}
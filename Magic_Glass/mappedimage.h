@@ -0,0 +1,57 @@
+/*
+	Zero-copy loading of binary PGM/PPM (P5/P6, 8 or 16 bits) and headerless raw gray or RGB files.
+	The file is mapped into memory (QFile::map) and described by a view that points straight at
+		the pixels with the file's own stride: gray as 8-bit indexed with a gray palette
+		(ImageView::Gray8 when the maxval is 255), RGB as Format_RGB888, which image() also
+		wraps in a read-only QImage.  The Histo kernels and ImagePanel then read from the page
+		cache and the image never takes heap memory.
+	16-bit samples (up to 65535; big-endian in PGM/PPM, little-endian in raw files) have no QImage
+		format and are only described by view(), as ImageView::Gray16 or Rgb48.  When the file's
+		byte order is not the machine's, the samples are read into memory once, byte-swapped, at
+		two bytes each.
+	Images of more than INT_MAX bytes are refused: QImage and the int offsets of ImageView and
+		Plane cannot address them.
+	The view and the QImage are only valid while their MappedImage lives; whoever holds copies of
+		them has to be done with them before the MappedImage is destroyed.
+*/
+#ifndef MAPPEDIMAGE_H
+#define MAPPEDIMAGE_H
+
+#include <QtGui>
+#include "imageview.h"
+
+class MappedImage
+{
+	Q_DECLARE_TR_FUNCTIONS (MappedImage)
+
+public:
+	// Pixel layouts of raw files.
+	enum Format {Gray8, Rgb888, Gray16, Rgb48};
+
+	MappedImage();
+	~MappedImage();
+	bool openNetpbm (const QString &fileName);
+	bool openRaw (const QString &fileName, const QSize &size, Format format, qint64 offset = 0);
+	void close();
+	const QImage &image() const;
+	const ImageView &view() const;
+	int maxValue() const;
+	qint64 heapBytes() const;
+	QString errorString() const;
+	static int bytesPerPixel (Format format);
+	static bool fits (const QSize &size, Format format);
+
+private:
+	bool open (const QString &fileName);
+	bool wrap (qint64 offset, int width, int height, Format format, bool bigEndian, int maxValue);
+	bool fail (const QString &message);
+
+	QFile file;
+	uchar *bits;
+	QImage wrapped;				// 8-bit RGB only
+	QVector<quint16> swapped;	// 16-bit samples of a file in the other byte order
+	ImageView source;
+	int maxval;
+	QString error;
+};
+#endif
@@ -0,0 +1,188 @@
+/*
+	The implementation of medianfilter.h.
+*/
+#include <QtGui>
+#include "medianfilter.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	enum {Coarse = 16, Fine = 256, Segment = 16};
+	enum {Stale = -1000000};
+
+	// dst += add - sub over one 16-bin segment.
+	inline void mergeSegment (quint16 *dst, const quint16 *add, const quint16 *sub)
+	{
+#if defined(__SSE2__)
+		for (int i = 0; i < Segment; i += 8)
+		{
+			__m128i d = _mm_loadu_si128 ((const __m128i *)(dst + i));
+			d = _mm_add_epi16 (d, _mm_loadu_si128 ((const __m128i *)(add + i)));
+			d = _mm_sub_epi16 (d, _mm_loadu_si128 ((const __m128i *)(sub + i)));
+			_mm_storeu_si128 ((__m128i *)(dst + i), d);
+		}
+#else
+		for (int i = 0; i < Segment; i++)
+			dst [i] += add [i] - sub [i];
+#endif
+	}
+
+	// dst += add over one 16-bin segment.
+	inline void addSegment (quint16 *dst, const quint16 *add)
+	{
+#if defined(__SSE2__)
+		for (int i = 0; i < Segment; i += 8)
+			_mm_storeu_si128 ((__m128i *)(dst + i), _mm_add_epi16 (_mm_loadu_si128 ((const __m128i *)(dst + i)), _mm_loadu_si128 ((const __m128i *)(add + i))));
+#else
+		for (int i = 0; i < Segment; i++)
+			dst [i] += add [i];
+#endif
+	}
+
+	// Output columns [first, last) of the plane.
+	struct Strip
+	{
+		int first;
+		int last;
+	};
+
+	// Column histograms of the columns one strip reads, [lo, hi).
+	struct Columns
+	{
+		Columns (const Plane &plane, int first, int last, int r)
+			: src (plane), lo (qMax (0, first - r)), hi (qMin (plane.width, last + r)),
+			  coarse ((hi - lo) * Coarse, 0), fine ((hi - lo) * Fine, 0) {}
+
+		// Add (or remove, sign -1) one image row.
+		void addRow (int y, int sign)
+		{
+			const uchar *line = src.scanLine (y);
+			quint16 *hc = coarse.data();
+			quint16 *hf = fine.data();
+			for (int c = lo; c < hi; c++)
+			{
+				hc [(c - lo) * Coarse + (line [c] >> 4)] += sign;
+				hf [(c - lo) * Fine + line [c]] += sign;
+			}
+		}
+
+		// Index of image column x, repeating the border columns.
+		int column (int x) const
+		{
+			return qBound (0, x, src.width - 1) - lo;
+		}
+
+		const Plane &src;
+		int lo;
+		int hi;
+		QVector<quint16> coarse;
+		QVector<quint16> fine;
+	};
+
+	void filterStrip (const Plane &src, const Plane &dst, int r, const Strip &strip)
+	{
+		int h = src.height;
+		Columns columns (src, strip.first, strip.last, r);
+		for (int i = -r; i <= r; i++)
+			columns.addRow (qBound (0, i, h - 1), 1);
+		const quint16 *hc = columns.coarse.constData();
+		const quint16 *hf = columns.fine.constData();
+
+		int half = (2 * r + 1) * (2 * r + 1) / 2;
+		quint16 coarse [Coarse];
+		quint16 fine [Fine];
+		int updated [Coarse];
+
+		for (int y = 0; y < h; y++)
+		{
+			memset (coarse, 0, sizeof (coarse));
+			for (int i = -r; i <= r; i++)
+				addSegment (coarse, hc + columns.column (strip.first + i) * Coarse);
+			for (int k = 0; k < Coarse; k++)
+				updated [k] = Stale;
+
+			uchar *out = dst.scanLine (y);
+			for (int x = strip.first; x < strip.last; x++)
+			{
+				if (x > strip.first)
+					mergeSegment (coarse, hc + columns.column (x + r) * Coarse, hc + columns.column (x - r - 1) * Coarse);
+
+				// Coarse bin holding the median, then the fine bin inside it.
+				int sum = 0;
+				int k = 0;
+				while (sum + coarse [k] <= half)
+					sum += coarse [k++];
+
+				quint16 *segment = fine + k * Segment;
+				if (x - updated [k] > r)
+				{
+					memset (segment, 0, Segment * sizeof (quint16));
+					for (int i = -r; i <= r; i++)
+						addSegment (segment, hf + columns.column (x + i) * Fine + k * Segment);
+				}
+				else
+				{
+					for (int j = updated [k] + 1; j <= x; j++)
+						mergeSegment (segment, hf + columns.column (j + r) * Fine + k * Segment,
+									  hf + columns.column (j - r - 1) * Fine + k * Segment);
+				}
+				updated [k] = x;
+
+				int v = 0;
+				while (sum + segment [v] <= half)
+					sum += segment [v++];
+				out [x] = k * Segment + v;
+			}
+
+			if (y + 1 < h)
+			{
+				columns.addRow (qBound (0, y - r, h - 1), -1);
+				columns.addRow (qBound (0, y + r + 1, h - 1), 1);
+			}
+		}
+	}
+
+	struct MedianStrip
+	{
+		MedianStrip (const Plane &s, const Plane &d, int radius) : src (s), dst (d), r (radius) {}
+
+		void operator() (const Strip &strip) const
+		{
+			filterStrip (src, dst, r, strip);
+		}
+
+		Plane src;
+		Plane dst;
+		int r;
+	};
+}
+
+/*
+	Median of the (2 radius + 1) square window around every pixel of src, written to dst (same
+		size, different buffer).  Radius 0 copies.
+*/
+void medianFilter (const Plane &src, const Plane &dst, int radius)
+{
+	if (src.isNull())
+		return;
+
+	if (radius <= 0)
+	{
+		for (int y = 0; y < src.height; y++)
+			memcpy (dst.scanLine (y), src.scanLine (y), src.width);
+		return;
+	}
+
+	int strips = qBound (1, src.width / 64, QThread::idealThreadCount() * 2);
+	QList<Strip> work;
+	for (int s = 0; s < strips; s++)
+	{
+		Strip strip = {src.width * s / strips, src.width * (s + 1) / strips};
+		work << strip;
+	}
+
+	QtConcurrent::blockingMap (work, MedianStrip (src, dst, radius));
+}
@@ -0,0 +1,17 @@
+/*
+	Median filter on 8-bit planes in constant time per pixel (Perreault and Hebert, 2007).
+	Every column keeps a histogram of the 2r + 1 rows around the current row; the histogram of
+		the square window is kept by adding the column entering on the right and removing the one
+		leaving on the left.  Histograms are two-level (16 coarse bins over 256 fine bins) and the
+		fine level is only brought up to date for the bin range that holds the median, so the
+		work per pixel barely depends on the radius.  Vertical strips run in parallel.
+	Used as a noise pre-stage before the edge operators.  Borders repeat the edge pixels.
+*/
+#ifndef MEDIANFILTER_H
+#define MEDIANFILTER_H
+
+#include <QtGui>
+#include "imageview.h"
+
+void medianFilter (const Plane &src, const Plane &dst, int radius);
+#endif
@@ -0,0 +1,88 @@
+/*
+	The implementation of memorybudget.h.
+*/
+#include <QtGui>
+#include "memorybudget.h"
+#include "ImagePanel.h"
+
+//	Constructor: 1 GB budget until the user picks another one.
+MemoryBudget::MemoryBudget(QObject *parent)
+	: QObject (parent)
+{
+	limit = (qint64)1024 * 1024 * 1024;
+	used = 0;
+	enforcing = false;
+}
+
+// Change the budget and evict right away if the documents no longer fit.
+void MemoryBudget::setBudget (qint64 bytes)
+{
+	limit = bytes;
+	enforce();
+	emit usageChanged (used, limit);
+}
+
+qint64 MemoryBudget::budget() const
+{
+	return limit;
+}
+
+qint64 MemoryBudget::total() const
+{
+	return used;
+}
+
+// Record how many bytes a document currently holds for one kind of data.
+void MemoryBudget::track (ImagePanel *doc, Kind kind, qint64 bytes)
+{
+	if (!recent.contains (doc))
+		recent.prepend (doc);
+
+	Usage &u = usage [doc];
+	used += bytes - u.bytes [kind];
+	u.bytes [kind] = bytes;
+
+	enforce();
+	emit usageChanged (used, limit);
+}
+
+// Mark a document as the active one (most recently used).
+void MemoryBudget::touch (ImagePanel *doc)
+{
+	recent.removeAll (doc);
+	recent.append (doc);
+}
+
+// Drop a document that is being closed.
+void MemoryBudget::forget (ImagePanel *doc)
+{
+	if (usage.contains (doc))
+	{
+		const Usage &u = usage [doc];
+		for (int i = 0; i < KindCount; i++)
+			used -= u.bytes [i];
+		usage.remove (doc);
+	}
+	recent.removeAll (doc);
+	emit usageChanged (used, limit);
+}
+
+/*
+	Release derived planes and caches of inactive documents, least recently used first, until the total
+		fits in the budget.  Source images and their statistics are never dropped; they are what the user opened.
+	Releasing calls back into track(), so re-entry is blocked while evicting.
+*/
+void MemoryBudget::enforce()
+{
+	if (enforcing || used <= limit)
+		return;
+
+	enforcing = true;
+	for (int i = 0; i < recent.size() - 1 && used > limit; i++)
+	{
+		const Usage &u = usage [recent [i]];
+		if (u.bytes [Derived] + u.bytes [Cache] > 0)
+			recent [i] -> releaseDerived();
+	}
+	enforcing = false;
+}
@@ -0,0 +1,48 @@
+/*
+	Central memory accountant shared by every open document.
+	Each ImagePanel reports how many bytes it holds for its source image, its statistics, derived
+		planes and caches.
+	When the total goes over the budget, derived data and caches of the least recently used inactive
+		documents are released until the total fits again; the active document is never evicted.
+		Statistics are kept with the source: counting a large image again costs more than they take.
+*/
+#ifndef MEMORYBUDGET_H
+#define MEMORYBUDGET_H
+
+#include <QtGui>
+
+class ImagePanel;
+
+class MemoryBudget : public QObject
+{
+	Q_OBJECT
+
+public:
+	enum Kind {Source, Statistics, Derived, Cache, KindCount};
+	MemoryBudget(QObject *parent = 0);
+	void setBudget (qint64 bytes);
+	qint64 budget() const;
+	qint64 total() const;
+	void track (ImagePanel *doc, Kind kind, qint64 bytes);
+	void touch (ImagePanel *doc);
+	void forget (ImagePanel *doc);
+
+signals:
+	void usageChanged (qint64 used, qint64 budget);
+
+private:
+	struct Usage
+	{
+		Usage() { for (int i = 0; i < KindCount; i++) bytes [i] = 0; }
+		qint64 bytes [KindCount];
+	};
+
+	void enforce();
+
+	QMap<ImagePanel *, Usage> usage;
+	QList<ImagePanel *> recent;		// least recently used first, active document last
+	qint64 limit;
+	qint64 used;
+	bool enforcing;
+};
+#endif
@@ -0,0 +1,178 @@
+/*
+	The implementation of morphology.h.
+*/
+#include <QtGui>
+#include "morphology.h"
+
+namespace
+{
+	struct Min
+	{
+		enum {Identity = 255};
+		static uchar apply (uchar a, uchar b) { return a < b ? a : b; }
+	};
+
+	struct Max
+	{
+		enum {Identity = 0};
+		static uchar apply (uchar a, uchar b) { return a > b ? a : b; }
+	};
+}
+
+Morphology::Morphology()
+	: op (None), element (Rectangle), size (3)
+{
+}
+
+void Morphology::setOperation (Operation o)
+{
+	op = o;
+}
+
+// Element size is the side of the square or the length of the line, in pixels (odd, at least 1).
+void Morphology::setElement (Element shape, int s)
+{
+	element = shape;
+	size = qMax (1, s | 1);
+}
+
+Morphology::Operation Morphology::operation() const
+{
+	return op;
+}
+
+// How far from a pixel the element reaches; callers pad the region they filter by this much.
+int Morphology::reach() const
+{
+	return op == None ? 0 : (op == Open || op == Close ? size - 1 : size / 2);
+}
+
+// Run the selected operation on the plane in place.
+void Morphology::apply (const Plane &plane)
+{
+	if (plane.isNull() || size < 2)
+		return;
+
+	switch (op)
+	{
+		case Erode:
+			erode (plane);
+			break;
+		case Dilate:
+			dilate (plane);
+			break;
+		case Open:
+			erode (plane);
+			dilate (plane);
+			break;
+		case Close:
+			dilate (plane);
+			erode (plane);
+			break;
+		default:
+			break;
+	}
+}
+
+void Morphology::erode (const Plane &plane)
+{
+	filter<Min> (plane);
+}
+
+void Morphology::dilate (const Plane &plane)
+{
+	filter<Max> (plane);
+}
+
+// Separable pass: along columns for the vertical extent, along rows (transposed) for the horizontal one.
+template <class Op>
+void Morphology::filter (const Plane &plane)
+{
+	if (element != HorizontalLine)
+		columns<Op> (plane, size);
+
+	if (element != VerticalLine)
+	{
+		flipped.resize (plane.width * plane.height);
+		Plane across (flipped.data(), plane.height, plane.height, plane.width);
+		transpose (plane, across);
+		columns<Op> (across, size);
+		transpose (across, plane);
+	}
+}
+
+/*
+	van Herk / Gil-Werman along columns with a window of k rows centered on each output row.
+	The padded column is cut into blocks of k rows; forward holds the running result from the top
+		of each block, backward from the bottom.  Any window of k rows spans at most two blocks,
+		so its result is Op (backward [first row], forward [last row]).
+*/
+template <class Op>
+void Morphology::columns (const Plane &plane, int k)
+{
+	int w = plane.width;
+	int h = plane.height;
+	int half = k / 2;
+	int rows = h + k - 1;
+
+	forward.resize (rows * w);
+	backward.resize (rows * w);
+	uchar *f = forward.data();
+	uchar *b = backward.data();
+
+	for (int r = 0; r < rows; r++)
+	{
+		int y = r - half;
+		uchar *out = f + r * w;
+		if (y < 0 || y >= h)
+			memset (out, Op::Identity, w);
+		else
+			memcpy (out, plane.scanLine (y), w);
+
+		if (r % k)
+		{
+			const uchar *above = out - w;
+			for (int x = 0; x < w; x++)
+				out [x] = Op::apply (out [x], above [x]);
+		}
+	}
+
+	for (int r = rows - 1; r >= 0; r--)
+	{
+		int y = r - half;
+		uchar *out = b + r * w;
+		if (y < 0 || y >= h)
+			memset (out, Op::Identity, w);
+		else
+			memcpy (out, plane.scanLine (y), w);
+
+		if (r % k != k - 1 && r != rows - 1)
+		{
+			const uchar *below = out + w;
+			for (int x = 0; x < w; x++)
+				out [x] = Op::apply (out [x], below [x]);
+		}
+	}
+
+	for (int y = 0; y < h; y++)
+	{
+		const uchar *first = b + y * w;
+		const uchar *last = f + (y + k - 1) * w;
+		uchar *out = plane.scanLine (y);
+		for (int x = 0; x < w; x++)
+			out [x] = Op::apply (first [x], last [x]);
+	}
+}
+
+// Transpose in 8x8 tiles to stay within cache lines on both sides.
+void Morphology::transpose (const Plane &from, const Plane &to)
+{
+	for (int y0 = 0; y0 < from.height; y0 += 8)
+		for (int x0 = 0; x0 < from.width; x0 += 8)
+			for (int y = y0; y < qMin (y0 + 8, from.height); y++)
+			{
+				const uchar *in = from.scanLine (y);
+				for (int x = x0; x < qMin (x0 + 8, from.width); x++)
+					to.scanLine (x) [y] = in [x];
+			}
+}
@@ -0,0 +1,43 @@
+/*
+	Binary/gray morphology on 8-bit planes: erode, dilate, open and close with a rectangular or
+		line structuring element.  Uses the van Herk / Gil-Werman running min/max, so the cost per
+		pixel does not depend on the element size: three comparisons per pixel and pass.
+	The pass along columns works on whole rows at a time, which the compiler vectorizes; the
+		pass along rows is done by transposing, running the column pass and transposing back.
+	Outside the plane, erosion sees 255 and dilation sees 0, so borders are not eaten away.
+*/
+#ifndef MORPHOLOGY_H
+#define MORPHOLOGY_H
+
+#include <QtGui>
+#include "imageview.h"
+
+class Morphology
+{
+public:
+	enum Operation {None, Erode, Dilate, Open, Close};
+	enum Element {Rectangle, HorizontalLine, VerticalLine};
+
+	Morphology();
+	void setOperation (Operation op);
+	void setElement (Element shape, int size);
+	Operation operation() const;
+	int reach() const;
+	void apply (const Plane &plane);
+
+private:
+	void erode (const Plane &plane);
+	void dilate (const Plane &plane);
+	template <class Op> void filter (const Plane &plane);
+	template <class Op> void columns (const Plane &plane, int k);
+	void transpose (const Plane &from, const Plane &to);
+
+	Operation op;
+	Element element;
+	int size;
+
+	QVector<uchar> forward;		// running min/max from the start of each block of k rows
+	QVector<uchar> backward;	// running min/max from the end of each block
+	QVector<uchar> flipped;		// transposed plane for the pass along rows
+};
+#endif
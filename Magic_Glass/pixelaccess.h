@@ -0,0 +1,139 @@
+/*
+	Compile-time pixel readers for the source formats the loader produces.
+	Each reader turns pixel x of a native scanline into an opaque QRgb, with no format switch
+		or bounds check per pixel.  dispatchPixels() looks at the layout of an ImageView once
+		and runs a kernel instantiated for the matching reader.
+	16-bit sources come out at their display levels (ImageView::window), so every 8-bit kernel
+		shows them as windowed; the kernels that need the full samples read them directly.
+	A kernel is a functor with a member template:
+		template <class Pixels> void operator() (const ImageView &src, const Pixels &pixels);
+*/
+#ifndef PIXELACCESS_H
+#define PIXELACCESS_H
+
+#include <QtGui>
+#include "imageview.h"
+
+// RGB32 and ARGB32: the pixel is already a QRgb; alpha is ignored.
+struct Rgb32Pixels
+{
+	QRgb operator() (const uchar *line, int x) const
+	{
+		return ((const QRgb *)line) [x] | 0xff000000;
+	}
+};
+
+// ARGB32 premultiplied: color channels are divided back by alpha.
+struct Argb32PremultipliedPixels
+{
+	QRgb operator() (const uchar *line, int x) const
+	{
+		QRgb p = ((const QRgb *)line) [x];
+		int a = qAlpha (p);
+		if (a == 255)
+			return p;
+		if (a == 0)
+			return qRgb (0, 0, 0);
+		return qRgb (qRed (p) * 255 / a, qGreen (p) * 255 / a, qBlue (p) * 255 / a);
+	}
+};
+
+// RGB888: three bytes per pixel in R, G, B order.
+struct Rgb888Pixels
+{
+	QRgb operator() (const uchar *line, int x) const
+	{
+		const uchar *p = line + 3 * x;
+		return qRgb (p [0], p [1], p [2]);
+	}
+};
+
+// Indexed8: one byte per pixel looked up in the color table, padded to 256 entries.
+struct Indexed8Pixels
+{
+	explicit Indexed8Pixels (const QVector<QRgb> &colors)
+	{
+		for (int i = 0; i < 256; i++)
+			table [i] = (i < colors.size() ? colors [i] : qRgb (0, 0, 0)) | 0xff000000;
+	}
+
+	QRgb operator() (const uchar *line, int x) const
+	{
+		return table [line [x]];
+	}
+
+	QRgb table [256];
+};
+
+// Gray8: one byte per pixel that is its own gray level; no table lookup.
+struct Gray8Pixels
+{
+	QRgb operator() (const uchar *line, int x) const
+	{
+		return qRgb (line [x], line [x], line [x]);
+	}
+};
+
+// Gray16: one 16-bit sample per pixel, shown at its level in the view's display window.
+struct Gray16Pixels
+{
+	explicit Gray16Pixels (const uchar *w) : window (w) {}
+
+	QRgb operator() (const uchar *line, int x) const
+	{
+		int v = window [((const quint16 *)line) [x]];
+		return qRgb (v, v, v);
+	}
+
+	const uchar *window;
+};
+
+// Rgb48: three 16-bit samples per pixel in R, G, B order, each shown through the display window.
+struct Rgb48Pixels
+{
+	explicit Rgb48Pixels (const uchar *w) : window (w) {}
+
+	QRgb operator() (const uchar *line, int x) const
+	{
+		const quint16 *p = (const quint16 *)line + 3 * x;
+		return qRgb (window [p [0]], window [p [1]], window [p [2]]);
+	}
+
+	const uchar *window;
+};
+
+/*
+	Run kernel on src with the reader for its layout.  Returns false (and does nothing) when the
+		layout is not supported; callers convert such images to RGB32 up front.
+*/
+template <class Kernel>
+bool dispatchPixels (const ImageView &src, Kernel &kernel)
+{
+	switch (src.layout)
+	{
+		case ImageView::Rgb32:
+			kernel (src, Rgb32Pixels());
+			return true;
+		case ImageView::Argb32Premultiplied:
+			kernel (src, Argb32PremultipliedPixels());
+			return true;
+		case ImageView::Rgb888:
+			kernel (src, Rgb888Pixels());
+			return true;
+		case ImageView::Indexed8:
+			kernel (src, Indexed8Pixels (src.colors));
+			return true;
+		case ImageView::Gray8:
+			kernel (src, Gray8Pixels());
+			return true;
+		case ImageView::Gray16:
+			kernel (src, Gray16Pixels (src.window.constData()));
+			return true;
+		case ImageView::Rgb48:
+			kernel (src, Rgb48Pixels (src.window.constData()));
+			return true;
+		default:
+			return false;
+	}
+}
+#endif
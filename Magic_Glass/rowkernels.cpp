@@ -0,0 +1,205 @@
+/*
+	The implementation of rowkernels.h.
+	Each kernel body is written once as a plain loop the compiler can vectorize, then compiled
+		again inside functions carrying a target attribute, so one binary holds a generic,
+		an AVX2 and an AVX-512 build of every loop.
+*/
+#include <QtGui>
+#include "rowkernels.h"
+#include "cpufeatures.h"
+
+// Release builds use -O2, which older GCC releases do not vectorize at.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC optimize ("tree-vectorize")
+#endif
+
+#if defined(__GNUC__)
+#define ROW_INLINE static inline __attribute__((always_inline))
+#define ROW_RESTRICT __restrict__
+#else
+#define ROW_INLINE static inline
+#define ROW_RESTRICT
+#endif
+
+namespace
+{
+	ROW_INLINE void grayBody (const QRgb *in, uchar *out, int count)
+	{
+		for (int x = 0; x < count; x++)
+			out [x] = (77 * ((in [x] >> 16) & 0xff) + 151 * ((in [x] >> 8) & 0xff) + 28 * (in [x] & 0xff)) >> 8;
+	}
+
+	ROW_INLINE QRgb grayPixel (int v)
+	{
+		return 0xff000000u | (v << 16) | (v << 8) | v;
+	}
+
+	ROW_INLINE void prewittBody (const uchar *p, const uchar *c, const uchar *n, QRgb *out, int w)
+	{
+		for (int x = 1; x < w - 1; x++)
+		{
+			int gx = (n[x-1] + n[x] + n[x+1]) - (p[x-1] + p[x] + p[x+1]);
+			int gy = (p[x+1] + c[x+1] + n[x+1]) - (p[x-1] + c[x-1] + n[x-1]);
+			int grad = (gx < 0 ? -gx : gx) + (gy < 0 ? -gy : gy);
+			out [x] = grayPixel (grad < 255 ? grad : 255);
+		}
+	}
+
+	ROW_INLINE void sobelBody (const uchar *p, const uchar *c, const uchar *n, QRgb *out, int w)
+	{
+		for (int x = 1; x < w - 1; x++)
+		{
+			int gx = (n[x-1] + 2*n[x] + n[x+1]) - (p[x-1] + 2*p[x] + p[x+1]);
+			int gy = (p[x+1] + 2*c[x+1] + n[x+1]) - (p[x-1] + 2*c[x-1] + n[x-1]);
+			int grad = (gx < 0 ? -gx : gx) + (gy < 0 ? -gy : gy);
+			out [x] = grayPixel (grad < 255 ? grad : 255);
+		}
+	}
+
+	ROW_INLINE void LoGBody (const uchar *pp, const uchar *p, const uchar *c, const uchar *n, const uchar *nn, QRgb *out, int w)
+	{
+		for (int x = 2; x < w - 2; x++)
+		{
+			int log = 16*c[x] - (pp[x] + p[x-1] + 2*p[x] + p[x+1] + c[x-2] + 2*c[x-1] + 2*c[x+1] + c[x+2] + n[x-1] + 2*n[x] + n[x+1] + nn[x]);
+			log = log < 0 ? 0 : log;
+			out [x] = grayPixel (log < 255 ? log : 255);
+		}
+	}
+
+	ROW_INLINE void luminanceBody (const QRgb *in, QRgb *out, int count)
+	{
+		for (int x = 0; x < count; x++)
+			out [x] = grayPixel ((77 * ((in [x] >> 16) & 0xff) + 151 * ((in [x] >> 8) & 0xff) + 28 * (in [x] & 0xff)) >> 8);
+	}
+
+	ROW_INLINE void thresholdBody (const QRgb *in, QRgb *out, int count, const uchar *lut)
+	{
+		for (int x = 0; x < count; x++)
+			out [x] = grayPixel (lut [(77 * ((in [x] >> 16) & 0xff) + 151 * ((in [x] >> 8) & 0xff) + 28 * (in [x] & 0xff)) >> 8]);
+	}
+
+	ROW_INLINE QRgb scaledPixel (int response, float gain)
+	{
+		int v = (int)(response * gain);
+		return grayPixel (v < 255 ? v : 255);
+	}
+
+	ROW_INLINE void prewitt16Body (const quint16 *p, const quint16 *c, const quint16 *n, QRgb *out, int w, float gain)
+	{
+		for (int x = 1; x < w - 1; x++)
+		{
+			int gx = (n[x-1] + n[x] + n[x+1]) - (p[x-1] + p[x] + p[x+1]);
+			int gy = (p[x+1] + c[x+1] + n[x+1]) - (p[x-1] + c[x-1] + n[x-1]);
+			out [x] = scaledPixel ((gx < 0 ? -gx : gx) + (gy < 0 ? -gy : gy), gain);
+		}
+	}
+
+	ROW_INLINE void sobel16Body (const quint16 *p, const quint16 *c, const quint16 *n, QRgb *out, int w, float gain)
+	{
+		for (int x = 1; x < w - 1; x++)
+		{
+			int gx = (n[x-1] + 2*n[x] + n[x+1]) - (p[x-1] + 2*p[x] + p[x+1]);
+			int gy = (p[x+1] + 2*c[x+1] + n[x+1]) - (p[x-1] + 2*c[x-1] + n[x-1]);
+			out [x] = scaledPixel ((gx < 0 ? -gx : gx) + (gy < 0 ? -gy : gy), gain);
+		}
+	}
+
+	ROW_INLINE void LoG16Body (const quint16 *pp, const quint16 *p, const quint16 *c, const quint16 *n, const quint16 *nn, QRgb *out, int w, float gain)
+	{
+		for (int x = 2; x < w - 2; x++)
+		{
+			int log = 16*c[x] - (pp[x] + p[x-1] + 2*p[x] + p[x+1] + c[x-2] + 2*c[x-1] + 2*c[x+1] + c[x+2] + n[x-1] + 2*n[x] + n[x+1] + nn[x]);
+			out [x] = scaledPixel (log < 0 ? 0 : log, gain);
+		}
+	}
+
+	ROW_INLINE void blendBody (const ushort *a, const ushort *b, const ushort *weight, uchar *out, int count)
+	{
+		for (int x = 0; x < count; x++)
+			out [x] = (a [x] * (256 - weight [x]) + b [x] * weight [x] + 32768) >> 16;
+	}
+
+	ROW_INLINE int clampLevel (int v)
+	{
+		return v < 0 ? 0 : v < 255 ? v : 255;
+	}
+
+	// Gathers through index, which the compiler cannot check against out for overlap; they never share memory.
+	template <int taps>
+	ROW_INLINE void resampleBody (const int *red, const int *green, const int *blue, const int *index, const int *weights, QRgb *ROW_RESTRICT out, int count)
+	{
+		for (int x = 0; x < count; x++)
+		{
+			const int *w = weights + x * taps;
+			int k = index [x];
+			int r = 32768 + w [0] * red [k] + w [1] * red [k + 1];
+			int g = 32768 + w [0] * green [k] + w [1] * green [k + 1];
+			int b = 32768 + w [0] * blue [k] + w [1] * blue [k + 1];
+			if (taps == 4)
+			{
+				r += w [2] * red [k + 2] + w [3] * red [k + 3];
+				g += w [2] * green [k + 2] + w [3] * green [k + 3];
+				b += w [2] * blue [k + 2] + w [3] * blue [k + 3];
+			}
+			out [x] = 0xff000000 | (clampLevel (r >> 16) << 16) | (clampLevel (g >> 16) << 8) | clampLevel (b >> 16);
+		}
+	}
+}
+
+// Instantiate every kernel body under one target attribute and collect them in a table.
+#define ROW_KERNELS(suffix, target) \
+	namespace \
+	{ \
+		target void gray_##suffix (const QRgb *in, uchar *out, int count) \
+			{ grayBody (in, out, count); } \
+		target void prewitt_##suffix (const uchar *p, const uchar *c, const uchar *n, QRgb *out, int w) \
+			{ prewittBody (p, c, n, out, w); } \
+		target void sobel_##suffix (const uchar *p, const uchar *c, const uchar *n, QRgb *out, int w) \
+			{ sobelBody (p, c, n, out, w); } \
+		target void LoG_##suffix (const uchar *pp, const uchar *p, const uchar *c, const uchar *n, const uchar *nn, QRgb *out, int w) \
+			{ LoGBody (pp, p, c, n, nn, out, w); } \
+		target void luminance_##suffix (const QRgb *in, QRgb *out, int count) \
+			{ luminanceBody (in, out, count); } \
+		target void threshold_##suffix (const QRgb *in, QRgb *out, int count, const uchar *lut) \
+			{ thresholdBody (in, out, count, lut); } \
+		target void blend_##suffix (const ushort *a, const ushort *b, const ushort *weight, uchar *out, int count) \
+			{ blendBody (a, b, weight, out, count); } \
+		target void prewitt16_##suffix (const quint16 *p, const quint16 *c, const quint16 *n, QRgb *out, int w, float gain) \
+			{ prewitt16Body (p, c, n, out, w, gain); } \
+		target void sobel16_##suffix (const quint16 *p, const quint16 *c, const quint16 *n, QRgb *out, int w, float gain) \
+			{ sobel16Body (p, c, n, out, w, gain); } \
+		target void LoG16_##suffix (const quint16 *pp, const quint16 *p, const quint16 *c, const quint16 *n, const quint16 *nn, QRgb *out, int w, float gain) \
+			{ LoG16Body (pp, p, c, n, nn, out, w, gain); } \
+		target void resample2_##suffix (const int *red, const int *green, const int *blue, const int *index, const int *weights, QRgb *out, int count) \
+			{ resampleBody<2> (red, green, blue, index, weights, out, count); } \
+		target void resample4_##suffix (const int *red, const int *green, const int *blue, const int *index, const int *weights, QRgb *out, int count) \
+			{ resampleBody<4> (red, green, blue, index, weights, out, count); } \
+		const RowKernels kernels_##suffix = \
+			{ gray_##suffix, prewitt_##suffix, sobel_##suffix, LoG_##suffix, luminance_##suffix, threshold_##suffix, \
+			  blend_##suffix, prewitt16_##suffix, sobel16_##suffix, LoG16_##suffix, resample2_##suffix, resample4_##suffix }; \
+	}
+
+ROW_KERNELS (generic, )
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ROW_KERNELS_X86
+ROW_KERNELS (avx2, __attribute__((target ("avx2"))))
+ROW_KERNELS (avx512, __attribute__((target ("avx512f,avx512bw"))))
+#endif
+
+// The kernel table for CpuFeatures::level(), picked on the first call.
+const RowKernels &rowKernels()
+{
+#if defined(ROW_KERNELS_X86)
+	switch (CpuFeatures::level())
+	{
+		case CpuFeatures::Avx512:
+			return kernels_avx512;
+		case CpuFeatures::Avx2:
+			return kernels_avx2;
+		default:
+			break;
+	}
+#endif
+	return kernels_generic;
+}
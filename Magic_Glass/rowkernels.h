@@ -0,0 +1,35 @@
+/*
+	Row kernels behind the gray, edge and lens code of Histo, built once per instruction set
+		level (see cpufeatures.h).  rowKernels() hands out the table for the level in use; the
+		choice is made once, so the loops themselves carry no per-pixel dispatch.
+	Edge rows take the gray rows above and below and write x = 1 .. w - 2 (2 .. w - 3 for LoG);
+		the caller writes the border pixels.
+	The 16-bit edge rows read planes of 16-bit sources with 32-bit sums and scale the response
+		by gain (255 over the width of the display window) before clamping it to 255.
+	blend mixes two rows of 8.8 fixed-point values by per-pixel weights out of 256 (CLAHE).
+	resample2 and resample4 blend 2 or 4 neighbouring entries of 8.8 fixed-point red, green and
+		blue rows, starting at index [x], by the weights [x * taps ..] out of 256 (magnifier.h).
+*/
+#ifndef ROWKERNELS_H
+#define ROWKERNELS_H
+
+#include <QtGui>
+
+struct RowKernels
+{
+	void (*gray) (const QRgb *in, uchar *out, int count);
+	void (*prewitt) (const uchar *p, const uchar *c, const uchar *n, QRgb *out, int w);
+	void (*sobel) (const uchar *p, const uchar *c, const uchar *n, QRgb *out, int w);
+	void (*LoG) (const uchar *pp, const uchar *p, const uchar *c, const uchar *n, const uchar *nn, QRgb *out, int w);
+	void (*luminance) (const QRgb *in, QRgb *out, int count);
+	void (*threshold) (const QRgb *in, QRgb *out, int count, const uchar *lut);
+	void (*blend) (const ushort *a, const ushort *b, const ushort *weight, uchar *out, int count);
+	void (*prewitt16) (const quint16 *p, const quint16 *c, const quint16 *n, QRgb *out, int w, float gain);
+	void (*sobel16) (const quint16 *p, const quint16 *c, const quint16 *n, QRgb *out, int w, float gain);
+	void (*LoG16) (const quint16 *pp, const quint16 *p, const quint16 *c, const quint16 *n, const quint16 *nn, QRgb *out, int w, float gain);
+	void (*resample2) (const int *red, const int *green, const int *blue, const int *index, const int *weights, QRgb *out, int count);
+	void (*resample4) (const int *red, const int *green, const int *blue, const int *index, const int *weights, QRgb *out, int count);
+};
+
+const RowKernels &rowKernels();
+#endif
@@ -0,0 +1,329 @@
+/*
+	The implementation of session.h.
+*/
+#include <QtGui>
+#include <cmath>
+#include "session.h"
+#include "mainwindow.h"
+
+SessionRecorder::SessionRecorder(MainWindow *w)
+	: QObject (w), window (w)
+{
+}
+
+/*
+	Start writing the trace.  From here on the view actions, the opened files, the label's
+		threshold, radius and magnification, the tabs, the window size and the mouse on every ImagePanel are
+		written as they happen.  Actions that open a dialog are not recorded.
+*/
+bool SessionRecorder::start (const QString &fileName)
+{
+	file.setFileName (fileName);
+	if (!file.open (QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+		return false;
+	out.setDevice (&file);
+	clock.start();
+
+	QList<QAction *> actions = window -> replayableActions();
+	for (int i = 0; i < actions.size(); i++)
+		connect (actions [i], SIGNAL (triggered()), this, SLOT (actionTriggered()));
+	connect (window, SIGNAL (documentOpened (const QString &)), this, SLOT (documentOpened (const QString &)));
+	connect (window -> label(), SIGNAL (thresLevelChanged (int)), this, SLOT (thresholdChanged (int)));
+	connect (window -> label(), SIGNAL (changedRadius (int)), this, SLOT (radiusChanged (int)));
+	connect (window -> label(), SIGNAL (changedMagnification (int)), this, SLOT (magnificationChanged (int)));
+	connect (window -> label(), SIGNAL (changedInterpolation (bool)), this, SLOT (interpolationChanged (bool)));
+	connect (window -> tabs(), SIGNAL (currentChanged (int)), this, SLOT (tabChanged (int)));
+	qApp -> installEventFilter (this);
+
+	write (QString ("window %1 %2").arg (window -> width()).arg (window -> height()));
+	return true;
+}
+
+// Mouse input on the image panels (in panel coordinates) and resizes of the main window.
+bool SessionRecorder::eventFilter (QObject *watched, QEvent *e)
+{
+	switch (e -> type())
+	{
+		case QEvent::MouseMove:
+		case QEvent::MouseButtonPress:
+		case QEvent::MouseButtonRelease:
+			if (qobject_cast<ImagePanel *>(watched))
+			{
+				QMouseEvent *mouse = static_cast<QMouseEvent *>(e);
+				const char *name = e -> type() == QEvent::MouseMove ? "move" : e -> type() == QEvent::MouseButtonPress ? "press" : "release";
+				write (QString ("%1 %2 %3").arg (name).arg (mouse -> x()).arg (mouse -> y()));
+			}
+			break;
+		case QEvent::Resize:
+			if (watched == window)
+				write (QString ("window %1 %2").arg (window -> width()).arg (window -> height()));
+			break;
+		default:
+			break;
+	}
+	return false;
+}
+
+// Actions are named by their menu text without the & of the shortcut letter.
+void SessionRecorder::actionTriggered()
+{
+	QAction *act = qobject_cast<QAction *>(sender());
+	if (act)
+		write ("action " + act -> text().remove ('&'));
+}
+
+void SessionRecorder::documentOpened (const QString &fileName)
+{
+	write ("open " + fileName);
+}
+
+void SessionRecorder::thresholdChanged (int value)
+{
+	write (QString ("threshold %1").arg (value));
+}
+
+void SessionRecorder::radiusChanged (int value)
+{
+	write (QString ("radius %1").arg (value));
+}
+
+void SessionRecorder::magnificationChanged (int value)
+{
+	write (QString ("magnification %1").arg (value));
+}
+
+void SessionRecorder::interpolationChanged (bool bicubic)
+{
+	write (QString ("bicubic %1").arg (bicubic ? 1 : 0));
+}
+
+void SessionRecorder::tabChanged (int index)
+{
+	write (QString ("tab %1").arg (index));
+}
+
+// One trace line: milliseconds since start() and the event.
+void SessionRecorder::write (const QString &event)
+{
+	out << clock.elapsed() << " " << event << "\n";
+}
+
+SessionReplay::SessionReplay(MainWindow *w)
+	: window (w), elapsed (0), skipped (0), buttons (Qt::NoButton)
+{
+}
+
+/*
+	Replay a trace into the window, which must be shown.  Events are sent at their recorded times
+		(so the frame pacing and the refinement of coarse frames behave as they did live), or back
+		to back when fast is set.  Events that cannot be replayed (an action that is disabled, a
+		file that no longer opens) are counted as skipped.  Returns false if the trace cannot be read.
+*/
+bool SessionReplay::run (const QString &fileName, bool fast)
+{
+	QFile file (fileName);
+	if (!file.open (QIODevice::ReadOnly | QIODevice::Text))
+	{
+		error = tr("Cannot read %1.").arg (fileName);
+		return false;
+	}
+
+	kinds.clear();
+	latencies.clear();
+	skipped = 0;
+	buttons = Qt::NoButton;
+	settle();
+
+	QElapsedTimer clock;
+	clock.start();
+	QTextStream in (&file);
+	while (!in.atEnd())
+	{
+		QString line = in.readLine().trimmed();
+		if (line.isEmpty() || line.startsWith ('#'))
+			continue;
+
+		bool ok = false;
+		qint64 at = line.section (' ', 0, 0).toLongLong (&ok);
+		QString event = line.section (' ', 1, 1);
+		if (!ok || event.isEmpty())
+		{
+			error = tr("%1: bad line \"%2\".").arg (fileName, line);
+			return false;
+		}
+
+		if (!fast)
+			waitFor (at - clock.elapsed());
+		if (!dispatch (event, line.section (' ', 2).trimmed()))
+			skipped++;
+	}
+
+	elapsed = clock.elapsed();
+	return true;
+}
+
+/*
+	Send one event and time it until its frame is painted.  After an open the full-resolution
+		decode and the statistics are waited for as well, timed separately as "ready", so later
+		events find the same state in every build.
+*/
+bool SessionReplay::dispatch (const QString &event, const QString &argument)
+{
+	QStringList args = argument.split (' ', QString::SkipEmptyParts);
+	ImagePanel *panel = window -> activeDocument();
+	QElapsedTimer timer;
+	timer.start();
+
+	if (event == "window" && args.size() == 2)
+	{
+		window -> resize (args [0].toInt(), args [1].toInt());
+		settle();
+		return true;
+	}
+	else if ((event == "move" || event == "press" || event == "release") && args.size() == 2)
+	{
+		QPoint pos (args [0].toInt(), args [1].toInt());
+		QEvent::Type type = QEvent::MouseMove;
+		Qt::MouseButton button = Qt::NoButton;
+		if (event == "press")
+		{
+			type = QEvent::MouseButtonPress;
+			button = Qt::LeftButton;
+			buttons = Qt::LeftButton;
+		}
+		else if (event == "release")
+		{
+			type = QEvent::MouseButtonRelease;
+			button = Qt::LeftButton;
+			buttons = Qt::NoButton;
+		}
+		QMouseEvent mouse (type, pos, panel -> mapToGlobal (pos), button, buttons, Qt::NoModifier);
+		QApplication::sendEvent (panel, &mouse);
+	}
+	else if (event == "action")
+	{
+		QList<QAction *> actions = window -> replayableActions();
+		int i = 0;
+		while (i < actions.size() && actions [i] -> text().remove ('&') != argument)
+			i++;
+		if (i == actions.size() || !actions [i] -> isEnabled())
+			return false;
+		actions [i] -> trigger();
+	}
+	else if (event == "open")
+	{
+		if (!window -> openFile (argument))
+			return false;
+	}
+	else if (event == "threshold" && args.size() == 1)
+		QMetaObject::invokeMethod (window, "threshold", Q_ARG (int, args [0].toInt()));
+	else if (event == "radius" && args.size() == 1)
+		window -> label() -> setRadius (args [0].toInt());
+	else if (event == "magnification" && args.size() == 1)
+		window -> label() -> setMagnification (args [0].toInt());
+	else if (event == "bicubic" && args.size() == 1)
+		window -> label() -> setBicubic (args [0].toInt() != 0);
+	else if (event == "tab" && args.size() == 1)
+	{
+		int index = args [0].toInt();
+		if (index < 0 || index >= window -> tabs() -> count())
+			return false;
+		window -> tabs() -> setCurrentIndex (index);
+	}
+	else
+		return false;
+
+	settle();
+	kinds << event;
+	latencies << timer.nsecsElapsed() / 1000;
+
+	if (event == "open")
+	{
+		panel = window -> activeDocument();
+		while ((panel -> isDecoding() || !panel -> histogram() -> isReady()) && timer.elapsed() < 60000)
+			waitFor (5);
+		kinds << "ready";
+		latencies << timer.nsecsElapsed() / 1000;
+	}
+	return true;
+}
+
+// Run the event loop for ms milliseconds.
+void SessionReplay::waitFor (qint64 ms)
+{
+	if (ms <= 0)
+		return;
+	QEventLoop loop;
+	QTimer::singleShot (ms, &loop, SLOT (quit()));
+	loop.exec();
+}
+
+// Let the GUI finish what the last event started: a position still waiting for the frame tick, then the posted repaints.
+void SessionReplay::settle()
+{
+	ImagePanel *panel = window -> activeDocument();
+	while (panel -> framePending())
+		QApplication::processEvents (QEventLoop::WaitForMoreEvents);
+	QApplication::sendPostedEvents();
+	QApplication::processEvents();
+}
+
+/*
+	Latency table of the last run: count, total, mean, median, 90th and 99th percentile and
+		maximum in milliseconds for each kind of event, in order of first appearance, then all together.
+*/
+QString SessionReplay::report() const
+{
+	QStringList names;
+	for (int i = 0; i < kinds.size(); i++)
+		if (!names.contains (kinds [i]))
+			names << kinds [i];
+	names << "all";
+
+	QString text = tr("%1 events replayed in %2 ms, %3 skipped.\n").arg (latencies.size()).arg (elapsed).arg (skipped);
+	text += QString ("%1%2%3%4%5%6%7%8\n").arg ("event", -10).arg ("count", 8).arg ("total", 12).arg ("mean", 10)
+				.arg ("p50", 10).arg ("p90", 10).arg ("p99", 10).arg ("max", 10);
+
+	for (int n = 0; n < names.size(); n++)
+	{
+		QVector<qint64> v;
+		for (int i = 0; i < kinds.size(); i++)
+			if (names [n] == "all" || kinds [i] == names [n])
+				v << latencies [i];
+		if (v.isEmpty())
+			continue;
+		qSort (v);
+
+		qint64 total = 0;
+		for (int i = 0; i < v.size(); i++)
+			total += v [i];
+
+		// Nearest-rank percentiles.
+		double rank [3] = {0.5, 0.9, 0.99};
+		double p [3];
+		for (int k = 0; k < 3; k++)
+			p [k] = v [qMax (0, (int)std::ceil (rank [k] * v.size()) - 1)] / 1000.0;
+
+		text += QString ("%1%2%3%4%5%6%7%8\n").arg (names [n], -10).arg (v.size(), 8)
+					.arg (total / 1000.0, 12, 'f', 2).arg (total / 1000.0 / v.size(), 10, 'f', 2)
+					.arg (p [0], 10, 'f', 2).arg (p [1], 10, 'f', 2).arg (p [2], 10, 'f', 2).arg (v.last() / 1000.0, 10, 'f', 2);
+	}
+	return text;
+}
+
+// Every latency of the last run, one "<event> <microseconds>" line per event, for comparing runs outside the program.
+bool SessionReplay::writeLatencies (const QString &fileName) const
+{
+	QFile file (fileName);
+	if (!file.open (QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+		return false;
+	QTextStream out (&file);
+	for (int i = 0; i < kinds.size(); i++)
+		out << kinds [i] << " " << latencies [i] << "\n";
+	return true;
+}
+
+QString SessionReplay::errorString() const
+{
+	return error;
+}
@@ -0,0 +1,69 @@
+/*
+	Recording and replay of interactive sessions, for comparing end-to-end latency between builds.
+	SessionRecorder writes what the user does in a MainWindow to a text trace, one event per line:
+		<milliseconds since the start> <event> [arguments]
+	SessionReplay feeds a trace back through the same paths the user took (synthetic mouse events
+		to the ImagePanel, QAction::trigger(), the MainWindow slots) and times every event until
+		the frame it caused has been painted.  See README.md for the events.
+*/
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <QtGui>
+
+class MainWindow;
+
+class SessionRecorder : public QObject
+{
+	Q_OBJECT
+
+public:
+	SessionRecorder(MainWindow *window);
+	bool start (const QString &fileName);
+
+protected:
+	bool eventFilter (QObject *watched, QEvent *e);
+
+private slots:
+	void actionTriggered();
+	void documentOpened (const QString &fileName);
+	void thresholdChanged (int value);
+	void radiusChanged (int value);
+	void magnificationChanged (int value);
+	void interpolationChanged (bool bicubic);
+	void tabChanged (int index);
+
+private:
+	void write (const QString &event);
+
+	MainWindow *window;
+	QFile file;
+	QTextStream out;
+	QElapsedTimer clock;
+};
+
+class SessionReplay
+{
+	Q_DECLARE_TR_FUNCTIONS(SessionReplay)
+
+public:
+	SessionReplay(MainWindow *window);
+	bool run (const QString &fileName, bool fast);
+	QString report() const;
+	bool writeLatencies (const QString &fileName) const;
+	QString errorString() const;
+
+private:
+	bool dispatch (const QString &event, const QString &argument);
+	void waitFor (qint64 ms);
+	void settle();
+
+	MainWindow *window;
+	QStringList kinds;			// event name of every replayed event, in order
+	QVector<qint64> latencies;	// and its latency in microseconds
+	qint64 elapsed;				// wall time of the whole replay, in milliseconds
+	int skipped;
+	Qt::MouseButtons buttons;
+	QString error;
+};
+#endif
@@ -0,0 +1,125 @@
+/*
+	The implementation of thumbnailbrowser.h.
+*/
+#include <QtGui>
+#include "thumbnailbrowser.h"
+
+namespace
+{
+	// One thumbnail for the decode pool.
+	struct FetchThumbnail
+	{
+		typedef Thumbnail result_type;
+
+		FetchThumbnail (const QStringList &c, int s) : cacheFiles (c), size (s) {}
+
+		Thumbnail operator() (const QPair<int, QString> &job) const
+		{
+			return ThumbnailCache::fetch (job.second, cacheFiles [job.first], size);
+		}
+
+		QStringList cacheFiles;
+		int size;
+	};
+}
+
+// 32 MB of thumbnails in memory, 256 MB on disk.
+ThumbnailBrowser::ThumbnailBrowser(QWidget *parent)
+	: QListWidget (parent), cache (32 << 20, 256 << 20)
+{
+	setViewMode (QListView::IconMode);
+	setIconSize (QSize (ThumbnailSize, ThumbnailSize));
+	setGridSize (QSize (ThumbnailSize + 16, ThumbnailSize + 32));
+	setResizeMode (QListView::Adjust);
+	setMovement (QListView::Static);
+	setUniformItemSizes (true);
+	setWrapping (true);
+
+	watcher = new QFutureWatcher<Thumbnail> (this);
+	connect (watcher, SIGNAL (resultReadyAt (int)), this, SLOT (thumbnailReady (int)));
+	connect (this, SIGNAL (itemActivated (QListWidgetItem *)), this, SLOT (chosen (QListWidgetItem *)));
+}
+
+ThumbnailBrowser::~ThumbnailBrowser()
+{
+	stop();
+}
+
+/*
+	Show the images of a folder, in name order.  Thumbnails still in memory appear at once; the
+		others are handed to the decode pool, and any fetches for the previous folder are stopped.
+*/
+void ThumbnailBrowser::setFolder (const QString &folder)
+{
+	stop();
+	clear();
+	path = folder;
+
+	QStringList filters;
+	QList<QByteArray> formats = QImageReader::supportedImageFormats();
+	for (int i = 0; i < formats.size(); i++)
+		filters << "*." + QString (formats [i]).toLower();
+	QFileInfoList files = QDir (folder).entryInfoList (filters, QDir::Files, QDir::Name | QDir::IgnoreCase);
+
+	QPixmap blank (ThumbnailSize, ThumbnailSize);
+	blank.fill (Qt::transparent);
+	QList<QPair<int, QString> > work;
+	QStringList cacheFiles;
+
+	for (int i = 0; i < files.size(); i++)
+	{
+		QString fileName = files [i].absoluteFilePath();
+		QListWidgetItem *item = new QListWidgetItem (QIcon (blank), files [i].fileName(), this);
+		item -> setData (Qt::UserRole, fileName);
+		item -> setToolTip (fileName);
+
+		Thumbnail thumbnail;
+		if (cache.find (fileName, &thumbnail))
+		{
+			item -> setIcon (QIcon (QPixmap::fromImage (thumbnail.image)));
+			continue;
+		}
+		work << qMakePair (cacheFiles.size(), fileName);
+		cacheFiles << cache.diskFile (fileName);
+		jobs << fileName;
+		jobItems << item;
+	}
+
+	if (!work.isEmpty())
+		watcher -> setFuture (QtConcurrent::mapped (work, FetchThumbnail (cacheFiles, ThumbnailSize)));
+}
+
+QString ThumbnailBrowser::folder() const
+{
+	return path;
+}
+
+// Cancel the fetches still queued and wait for the ones running, which may point into the old items.
+void ThumbnailBrowser::stop()
+{
+	watcher -> cancel();
+	watcher -> waitForFinished();
+	jobs.clear();
+	jobItems.clear();
+}
+
+// A worker finished a thumbnail: remember it and put it into its grid item.
+void ThumbnailBrowser::thumbnailReady (int index)
+{
+	if (index >= jobs.size())
+		return;
+
+	Thumbnail thumbnail = watcher -> resultAt (index);
+	cache.insert (jobs [index], thumbnail);
+	if (!thumbnail.image.isNull())
+		jobItems [index] -> setIcon (QIcon (QPixmap::fromImage (thumbnail.image)));
+}
+
+// Open the activated image, handing over its thumbnail (if it is ready) for the first display.
+void ThumbnailBrowser::chosen (QListWidgetItem *item)
+{
+	QString fileName = item -> data (Qt::UserRole).toString();
+	Thumbnail thumbnail;
+	cache.find (fileName, &thumbnail);
+	emit imageChosen (fileName, thumbnail.image, thumbnail.fullSize);
+}
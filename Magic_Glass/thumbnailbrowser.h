@@ -0,0 +1,44 @@
+/*
+	Thumbnail grid of the images in one folder, for triaging many files.
+	Thumbnails come from ThumbnailCache: from memory at once, else from a pool of worker threads
+		(QtConcurrent::mapped) that read them back from the disk cache or decode the files at
+		reduced size, so the grid fills in while the user is already scrolling.
+	Activating a thumbnail (double click or Enter) emits imageChosen() with the thumbnail and the
+		size of its source image; the new document shows it enlarged until its full-resolution
+		decode is done.
+*/
+#ifndef THUMBNAILBROWSER_H
+#define THUMBNAILBROWSER_H
+
+#include <QtGui>
+#include "thumbnailcache.h"
+
+class ThumbnailBrowser : public QListWidget
+{
+	Q_OBJECT
+
+public:
+	ThumbnailBrowser(QWidget *parent = 0);
+	~ThumbnailBrowser();
+	void setFolder (const QString &path);
+	QString folder() const;
+
+signals:
+	void imageChosen (const QString &fileName, const QImage &preview, const QSize &previewSource);
+
+private slots:
+	void thumbnailReady (int index);
+	void chosen (QListWidgetItem *item);
+
+private:
+	enum {ThumbnailSize = 128};
+
+	void stop();
+
+	ThumbnailCache cache;
+	QFutureWatcher<Thumbnail> *watcher;
+	QStringList jobs;					// source files being fetched, in the order of the future's results
+	QList<QListWidgetItem *> jobItems;	// and the grid item each one goes into
+	QString path;
+};
+#endif
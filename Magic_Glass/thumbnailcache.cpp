@@ -0,0 +1,120 @@
+/*
+	The implementation of thumbnailcache.h.
+*/
+#include <QtGui>
+#include "thumbnailcache.h"
+
+// Open the disk cache and take stock of what earlier sessions left in it, oldest first.
+ThumbnailCache::ThumbnailCache(qint64 memoryBytes, qint64 diskBytes)
+	: diskLimit (diskBytes), diskUsed (0)
+{
+	memory.setMaxCost ((int)qMin (memoryBytes / 1024, (qint64)INT_MAX));
+
+	directory = QDesktopServices::storageLocation (QDesktopServices::CacheLocation);
+	if (directory.isEmpty())
+		directory = QDir::tempPath() + "/Magic Glass";
+	directory += "/thumbnails";
+	QDir().mkpath (directory);
+
+	QFileInfoList files = QDir (directory).entryInfoList (QStringList ("*.png"), QDir::Files, QDir::Time | QDir::Reversed);
+	for (int i = 0; i < files.size(); i++)
+		useDiskFile (files [i].absoluteFilePath(), files [i].size());
+}
+
+// Look a thumbnail up in memory.  A hit also counts as a use of its disk file.
+bool ThumbnailCache::find (const QString &fileName, Thumbnail *thumbnail)
+{
+	QString key = diskFile (fileName);
+	Thumbnail *cached = memory.object (key);
+	if (!cached)
+		return false;
+
+	*thumbnail = *cached;
+	if (diskSizes.contains (key))
+		useDiskFile (key, cached -> diskBytes);
+	return true;
+}
+
+// Keep a thumbnail fetch() made (or read back) in memory and account for its disk file.
+void ThumbnailCache::insert (const QString &fileName, const Thumbnail &thumbnail)
+{
+	if (thumbnail.image.isNull())
+		return;
+
+	QString key = diskFile (fileName);
+	memory.insert (key, new Thumbnail (thumbnail), thumbnail.image.byteCount() / 1024 + 1);
+	if (thumbnail.diskBytes)
+		useDiskFile (key, thumbnail.diskBytes);
+}
+
+// The PNG the thumbnail of fileName is kept in, named after the file's path, size and modification time.
+QString ThumbnailCache::diskFile (const QString &fileName) const
+{
+	QFileInfo info (fileName);
+	QString id = QString ("%1|%2|%3").arg (info.absoluteFilePath()).arg (info.size()).arg (info.lastModified().toTime_t());
+	return directory + "/" + QCryptographicHash::hash (id.toUtf8(), QCryptographicHash::Md5).toHex() + ".png";
+}
+
+/*
+	Worker thread: the thumbnail of fileName, at most size pixels across, read back from
+		cacheFile if an earlier fetch wrote it, else decoded at reduced size (QImageReader::
+		setScaledSize, as in ImageLoader::preview) and written to cacheFile.
+	Returns a null image if the file cannot be decoded.
+*/
+Thumbnail ThumbnailCache::fetch (const QString &fileName, const QString &cacheFile, int size)
+{
+	Thumbnail thumbnail;
+	if (thumbnail.image.load (cacheFile, "PNG"))
+	{
+		QStringList full = thumbnail.image.text ("Source Size").split ('x');
+		if (full.size() == 2)
+		{
+			thumbnail.fullSize = QSize (full [0].toInt(), full [1].toInt());
+			thumbnail.diskBytes = QFileInfo (cacheFile).size();
+			return thumbnail;
+		}
+	}
+
+	QImageReader reader (fileName);
+	QSize full = reader.size();
+	if (full.isValid() && (full.width() > size || full.height() > size))
+	{
+		QSize scaled = full;
+		scaled.scale (size, size, Qt::KeepAspectRatio);
+		reader.setScaledSize (scaled);
+	}
+
+	thumbnail.image = reader.read();
+	if (thumbnail.image.isNull())
+		return thumbnail;
+	if (!full.isValid())
+		full = thumbnail.image.size();
+	if (thumbnail.image.width() > size || thumbnail.image.height() > size)
+		thumbnail.image = thumbnail.image.scaled (size, size, Qt::KeepAspectRatio);
+
+	thumbnail.fullSize = full;
+	thumbnail.image.setText ("Source Size", QString ("%1x%2").arg (full.width()).arg (full.height()));
+	if (thumbnail.image.save (cacheFile, "PNG"))
+		thumbnail.diskBytes = QFileInfo (cacheFile).size();
+	return thumbnail;
+}
+
+// Move a disk file to the most recently used end, then delete the least recently used ones until the disk level fits.
+void ThumbnailCache::useDiskFile (const QString &cacheFile, qint64 bytes)
+{
+	if (diskSizes.contains (cacheFile))
+	{
+		diskOrder.removeOne (cacheFile);
+		diskUsed -= diskSizes [cacheFile];
+	}
+	diskOrder << cacheFile;
+	diskSizes [cacheFile] = bytes;
+	diskUsed += bytes;
+
+	while (diskUsed > diskLimit && diskOrder.size() > 1)
+	{
+		QString oldest = diskOrder.takeFirst();
+		diskUsed -= diskSizes.take (oldest);
+		QFile::remove (oldest);
+	}
+}
@@ -0,0 +1,44 @@
+/*
+	Two-level LRU cache of folder thumbnails.
+	The memory level is a QCache of decoded thumbnails, charged by their size in bytes.  The disk
+		level keeps one PNG per source file in the user's cache directory, named by a hash of the
+		path, size and modification time (an edited file gets a new thumbnail); the size of the
+		full-resolution image is kept in the PNG's text.  Disk files past their budget are deleted
+		least recently used first: recency is tracked exactly within a session and starts from
+		the files' modification times in the next one.
+	fetch() is what the decode pool runs on worker threads; the rest belongs to the GUI thread.
+*/
+#ifndef THUMBNAILCACHE_H
+#define THUMBNAILCACHE_H
+
+#include <QtGui>
+
+struct Thumbnail
+{
+	Thumbnail() : diskBytes (0) {}
+
+	QImage image;
+	QSize fullSize;		// of the source image
+	qint64 diskBytes;	// of the PNG in the disk cache; 0 if it could not be written
+};
+
+class ThumbnailCache
+{
+public:
+	ThumbnailCache(qint64 memoryBytes, qint64 diskBytes);
+	bool find (const QString &fileName, Thumbnail *thumbnail);
+	void insert (const QString &fileName, const Thumbnail &thumbnail);
+	QString diskFile (const QString &fileName) const;
+	static Thumbnail fetch (const QString &fileName, const QString &cacheFile, int size);
+
+private:
+	void useDiskFile (const QString &cacheFile, qint64 bytes);
+
+	QCache<QString, Thumbnail> memory;	// keyed by disk file name; cost in KB
+	QString directory;
+	QStringList diskOrder;				// cache files, least recently used first
+	QHash<QString, qint64> diskSizes;
+	qint64 diskLimit;
+	qint64 diskUsed;
+};
+#endif